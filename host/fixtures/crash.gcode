@@ -0,0 +1,37 @@
+; M120 crash stop: 1 mm moves run X into its endstop while the planner is
+; full. The print pauses at X0 and nothing queued after the hit may move.
+G28
+G90
+G1 X20 Y20 F3000
+M120
+G1 X19 F600
+G1 X18 F600
+G1 X17 F600
+G1 X16 F600
+G1 X15 F600
+G1 X14 F600
+G1 X13 F600
+G1 X12 F600
+G1 X11 F600
+G1 X10 F600
+G1 X9 F600
+G1 X8 F600
+G1 X7 F600
+G1 X6 F600
+G1 X5 F600
+G1 X4 F600
+G1 X3 F600
+G1 X2 F600
+G1 X1 F600
+G1 X0 F600
+G1 X-1 F600
+G1 X-2 F600
+G1 X-3 F600
+G1 X-4 F600
+G1 X-5 F600
+G1 X-6 F600
+G1 X-7 F600
+G1 X-8 F600
+G1 X-9 F600
+G1 X-10 F600
+G1 X120 Y32 F3000
@@ -0,0 +1,14 @@
+; Printing moves with E, retract and prime, relative extrusion
+G28
+G90
+M83
+G92 E0
+G1 Z0.3 F600
+G1 X20 Y20 F6000
+G1 X60 Y20 E2.0 F1800
+G1 X60 Y40 E1.0
+G1 E-2 F2400
+G1 X20 Y40 F6000
+G1 E2 F2400
+G1 X20 Y20 E1.0 F1800
+M400
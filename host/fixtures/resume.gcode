@@ -0,0 +1,44 @@
+; M120 crash stop mid-move with a move still waiting for planner room: X
+; runs into its endstop during G1 X-5 while the Y moves behind it fill the
+; planner. The button resumes the print 2 s later. The move that waited
+; through the hit is dropped, so X stays at 0 and the Y moves sent after
+; it run from there.
+; host: -b 2
+G28
+G90
+G1 X20 Y20 F3000
+M120
+G1 X19 F600
+G1 X18 F600
+G1 X17 F600
+G1 X16 F600
+G1 X15 F600
+G1 X14 F600
+G1 X13 F600
+G1 X12 F600
+G1 X11 F600
+G1 X10 F600
+G1 X9 F600
+G1 X8 F600
+G1 X7 F600
+G1 X6 F600
+G1 X5 F600
+G1 X4 F600
+G1 X3 F600
+G1 X2 F600
+G1 X1 F600
+G1 X-5 F600
+G1 Y21 F600
+G1 Y22 F600
+G1 Y23 F600
+G1 Y24 F600
+G1 Y25 F600
+G1 Y26 F600
+G1 Y27 F600
+G1 Y28 F600
+G1 Y29 F600
+G1 Y30 F600
+G1 Y31 F600
+G1 Y32 F600
+M121
+M400
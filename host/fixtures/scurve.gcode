@@ -0,0 +1,16 @@
+; The square of square.gcode with the S-curve profile
+G28
+G90
+M205 P1
+G1 Z5 F600
+G1 X10 Y10 F6000
+G1 X50 Y10 F3000
+G1 X50 Y50
+G1 X10 Y50
+G1 X10 Y10
+G1 X50 Y10 F9000
+G1 X50 Y50
+G1 X10 Y50
+G1 X10 Y10
+M205 P0
+M400
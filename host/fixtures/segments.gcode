@@ -0,0 +1,109 @@
+; 20 mm circle in 1 mm segments, then a zigzag of 0.5 mm steps
+G28
+G90
+G1 Z2 F600
+G1 X40 Y30 F6000
+G1 F4800
+G1 X39.949 Y31.012
+G1 X39.795 Y32.013
+G1 X39.541 Y32.994
+G1 X39.190 Y33.944
+G1 X38.743 Y34.853
+G1 X38.208 Y35.713
+G1 X37.588 Y36.514
+G1 X36.890 Y37.248
+G1 X36.121 Y37.908
+G1 X35.290 Y38.486
+G1 X34.404 Y38.978
+G1 X33.473 Y39.378
+G1 X32.507 Y39.681
+G1 X31.514 Y39.885
+G1 X30.506 Y39.987
+G1 X29.494 Y39.987
+G1 X28.486 Y39.885
+G1 X27.493 Y39.681
+G1 X26.527 Y39.378
+G1 X25.596 Y38.978
+G1 X24.710 Y38.486
+G1 X23.879 Y37.908
+G1 X23.110 Y37.248
+G1 X22.412 Y36.514
+G1 X21.792 Y35.713
+G1 X21.257 Y34.853
+G1 X20.810 Y33.944
+G1 X20.459 Y32.994
+G1 X20.205 Y32.013
+G1 X20.051 Y31.012
+G1 X20.000 Y30.000
+G1 X20.051 Y28.988
+G1 X20.205 Y27.987
+G1 X20.459 Y27.006
+G1 X20.810 Y26.056
+G1 X21.257 Y25.147
+G1 X21.792 Y24.287
+G1 X22.412 Y23.486
+G1 X23.110 Y22.752
+G1 X23.879 Y22.092
+G1 X24.710 Y21.514
+G1 X25.596 Y21.022
+G1 X26.527 Y20.622
+G1 X27.493 Y20.319
+G1 X28.486 Y20.115
+G1 X29.494 Y20.013
+G1 X30.506 Y20.013
+G1 X31.514 Y20.115
+G1 X32.507 Y20.319
+G1 X33.473 Y20.622
+G1 X34.404 Y21.022
+G1 X35.290 Y21.514
+G1 X36.121 Y22.092
+G1 X36.890 Y22.752
+G1 X37.588 Y23.486
+G1 X38.208 Y24.287
+G1 X38.743 Y25.147
+G1 X39.190 Y26.056
+G1 X39.541 Y27.006
+G1 X39.795 Y27.987
+G1 X39.949 Y28.988
+G1 X40.000 Y30.000
+G1 X10.5 Y10.5
+G1 X11.0 Y10.0
+G1 X11.5 Y10.5
+G1 X12.0 Y10.0
+G1 X12.5 Y10.5
+G1 X13.0 Y10.0
+G1 X13.5 Y10.5
+G1 X14.0 Y10.0
+G1 X14.5 Y10.5
+G1 X15.0 Y10.0
+G1 X15.5 Y10.5
+G1 X16.0 Y10.0
+G1 X16.5 Y10.5
+G1 X17.0 Y10.0
+G1 X17.5 Y10.5
+G1 X18.0 Y10.0
+G1 X18.5 Y10.5
+G1 X19.0 Y10.0
+G1 X19.5 Y10.5
+G1 X20.0 Y10.0
+G1 X20.5 Y10.5
+G1 X21.0 Y10.0
+G1 X21.5 Y10.5
+G1 X22.0 Y10.0
+G1 X22.5 Y10.5
+G1 X23.0 Y10.0
+G1 X23.5 Y10.5
+G1 X24.0 Y10.0
+G1 X24.5 Y10.5
+G1 X25.0 Y10.0
+G1 X25.5 Y10.5
+G1 X26.0 Y10.0
+G1 X26.5 Y10.5
+G1 X27.0 Y10.0
+G1 X27.5 Y10.5
+G1 X28.0 Y10.0
+G1 X28.5 Y10.5
+G1 X29.0 Y10.0
+G1 X29.5 Y10.5
+G1 X30.0 Y10.0
+M400
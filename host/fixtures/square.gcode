@@ -0,0 +1,14 @@
+; 40 mm square at two speeds, corners at full stop and with junction speed
+G28
+G90
+G1 Z5 F600
+G1 X10 Y10 F6000
+G1 X50 Y10 F3000
+G1 X50 Y50
+G1 X10 Y50
+G1 X10 Y10
+G1 X50 Y10 F9000
+G1 X50 Y50
+G1 X10 Y50
+G1 X10 Y10
+M400
@@ -0,0 +1,523 @@
+// G-code throughput benchmark: feeds slicer-like G-code through the
+// firmware's command path on the host and reports lines/s, bytes/s and
+// heap use per line as JSON. Each corpus is timed three times:
+//   legacy    the String front end the parser replaced: readStringUntil(),
+//             cleanGcode() and the indexOf()/substring()/toFloat() parameter
+//             extraction of handleMoveCommand(), on a stand-in with the
+//             allocation behaviour of the AVR core's WString
+//   parse     parseGcodeLine() alone on a copy of every line
+//   dispatch  enqueueCommand() + processGcode(), i.e. parsing, the command
+//             table, handleMoveCommand() and the planner
+// Motion is stubbed: no step interrupt runs and, once the planner is
+// full, its oldest block is dropped before each line, so every move is
+// planned against a full look-ahead buffer as during a print.
+//
+//   gcode_bench [-n passes] [-o result.json] [file.gcode ...]
+//
+// Without files the built-in corpora are used (dense arcs, vase mode,
+// travel-heavy infill, and the arcs with line numbers and checksums).
+// Times are host times: compare runs on the same machine, not with the
+// AVR.
+#include "host.h"
+#include "gcode.h"
+#include "parser.h"
+#include "planner.h"
+#include "serial_rx.h"
+#include <ctype.h>
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+void setup();
+
+// ----- Heap accounting -----
+// malloc and friends are replaced for the whole program and forward to
+// glibc; only calls made while `counting` is set are recorded.
+
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+extern "C" void __libc_free(void*);
+
+static bool counting = false;
+static unsigned long allocations = 0;
+static long liveBytes = 0;      // allocated minus freed since counting began
+static long peakBytes = 0;
+
+static void noteAlloc(void* p) {
+    if (!counting || !p) return;
+    allocations++;
+    liveBytes += malloc_usable_size(p);
+    if (liveBytes > peakBytes) peakBytes = liveBytes;
+}
+
+static void noteFree(void* p) {
+    if (counting && p) liveBytes -= malloc_usable_size(p);
+}
+
+extern "C" void* malloc(size_t size) {
+    void* p = __libc_malloc(size);
+    noteAlloc(p);
+    return p;
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+    void* p = __libc_calloc(n, size);
+    noteAlloc(p);
+    return p;
+}
+
+extern "C" void* realloc(void* old, size_t size) {
+    noteFree(old);
+    void* p = __libc_realloc(old, size);
+    noteAlloc(p);
+    return p;
+}
+
+extern "C" void free(void* p) {
+    noteFree(p);
+    __libc_free(p);
+}
+
+// ----- Corpora -----
+
+struct Corpus {
+    std::string name;
+    std::vector<std::string> lines;
+    size_t bytes = 0;
+
+    void add(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+void Corpus::add(const char* fmt, ...) {
+    char buf[GCODE_LINE_MAX + 32];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    lines.push_back(buf);
+    bytes += lines.back().size() + 1;   // and the newline
+}
+
+// Short chords around circles, as a slicer writes holes and rounded
+// perimeters without arc fitting
+static Corpus denseArcs() {
+    Corpus c;
+    c.name = "arcs";
+    for (int layer = 0; layer < 20; layer++) {
+        c.add(";LAYER:%d", layer);
+        c.add("G1 Z%.3f F600", 0.2 + layer * 0.2);
+        c.add("G92 E0");
+        c.add(";TYPE:WALL-OUTER");
+        for (int ring = 0; ring < 4; ring++) {
+            float r = 3.0f + ring * 2.5f;
+            int segments = (int)(2 * M_PI * r / 0.3f);
+            c.add("G0 F9000 X%.3f Y%.3f", 100 + r, 100.0f);
+            for (int i = 1; i <= segments; i++) {
+                float a = 2 * M_PI * i / segments;
+                c.add("G1 F1800 X%.3f Y%.3f E%.5f", 100 + r * cosf(a), 100 + r * sinf(a), 0.01247f);
+            }
+        }
+    }
+    return c;
+}
+
+// One continuous spiral: every segment climbs a little and extrudes
+static Corpus vaseMode() {
+    Corpus c;
+    c.name = "vase";
+    c.add(";TYPE:WALL-OUTER");
+    float z = 0.4f;
+    const int perTurn = 180;
+    for (int turn = 0; turn < 25; turn++) {
+        for (int i = 0; i < perTurn; i++) {
+            float a = 2 * M_PI * i / perTurn;
+            float r = 20.0f + 2.0f * sinf(3 * a);
+            z += 0.2f / perTurn;
+            c.add("G1 X%.3f Y%.3f Z%.3f E%.5f", 100 + r * cosf(a), 100 + r * sinf(a), z, 0.02361f);
+        }
+        if (turn % 5 == 4) c.add("G92 E0");
+    }
+    return c;
+}
+
+// Sparse infill: long extrusions between travels with retraction and
+// z-hop, plus the per-feature acceleration changes
+static Corpus travelInfill() {
+    Corpus c;
+    c.name = "infill";
+    for (int layer = 0; layer < 20; layer++) {
+        float z = 0.2f + layer * 0.2f;
+        c.add(";LAYER:%d", layer);
+        c.add("G92 E0");
+        c.add(";TYPE:FILL");
+        c.add("M204 S1500");
+        for (int line = 0; line < 60; line++) {
+            float x0 = 60 + (line * 7) % 80, y0 = 60 + (line * 13) % 80;
+            c.add("G1 E-0.8 F2100");
+            c.add("G1 Z%.3f F600", z + 0.4f);
+            c.add("G0 F9000 X%.3f Y%.3f", x0, y0);
+            c.add("G1 Z%.3f F600", z);
+            c.add("G1 E0.8 F2100");
+            c.add("G1 F3000 X%.3f Y%.3f E%.5f", x0 + 20, y0 + 20, 0.94037f);
+            c.add("G1 X%.3f Y%.3f E%.5f", x0 + 25, y0 + 15, 0.23518f);
+        }
+        c.add(";TYPE:SKIRT");
+        c.add("M204 S500");
+    }
+    return c;
+}
+
+// What a print host sends: N words and a checksum on every line
+static Corpus numbered(const Corpus& source) {
+    Corpus c;
+    c.name = source.name + "-checksummed";
+    long n = 1;
+    for (const std::string& line : source.lines) {
+        if (line[0] == ';') continue;    // hosts strip comments before sending
+        char buf[GCODE_LINE_MAX];
+        snprintf(buf, sizeof(buf), "N%ld %s", n++, line.c_str());
+        uint8_t sum = 0;
+        for (const char* p = buf; *p; p++) sum ^= (uint8_t)*p;
+        c.add("%s*%u", buf, sum);
+    }
+    return c;
+}
+
+static bool readCorpus(const char* path, Corpus& c) {
+    FILE* in = fopen(path, "r");
+    if (!in) return false;
+    const char* base = strrchr(path, '/');
+    c.name = base ? base + 1 : path;
+    char buf[256];
+    while (fgets(buf, sizeof(buf), in)) {
+        size_t len = strcspn(buf, "\r\n");
+        c.bytes += strlen(buf);
+        buf[len] = '\0';
+        c.lines.push_back(buf);
+    }
+    fclose(in);
+    return true;
+}
+
+// ----- Legacy String front end -----
+// The line handling from before parseGcodeLine(), kept so the two can be
+// compared on the same corpora. LegacyString allocates like WString: every
+// growth is an exact-size realloc and substring() returns a new copy.
+
+class LegacyString {
+public:
+    LegacyString() {}
+    LegacyString(const LegacyString&) = delete;
+    LegacyString(LegacyString&& other) : buffer(other.buffer), capacity(other.capacity), len(other.len) {
+        other.buffer = nullptr;
+        other.capacity = other.len = 0;
+    }
+    ~LegacyString() { free(buffer); }
+
+    LegacyString& operator=(LegacyString&& other) {
+        if (this != &other) {
+            free(buffer);
+            buffer = other.buffer;
+            capacity = other.capacity;
+            len = other.len;
+            other.buffer = nullptr;
+            other.capacity = other.len = 0;
+        }
+        return *this;
+    }
+
+    bool reserve(unsigned size) {
+        if (buffer && capacity >= size) return true;
+        char* grown = (char*)realloc(buffer, size + 1);
+        if (!grown) return false;
+        buffer = grown;
+        capacity = size;
+        if (len == 0) buffer[0] = '\0';
+        return true;
+    }
+    void copy(const char* text, unsigned n) {
+        if (!reserve(n)) return;
+        len = n;
+        memcpy(buffer, text, n);
+        buffer[n] = '\0';
+    }
+    LegacyString& operator+=(char c) {
+        if (!reserve(len + 1)) return *this;
+        buffer[len++] = c;
+        buffer[len] = '\0';
+        return *this;
+    }
+
+    unsigned length() const { return len; }
+    char operator[](unsigned i) const { return i < len ? buffer[i] : 0; }
+    int indexOf(char c, unsigned from = 0) const {
+        if (from >= len) return -1;
+        const char* p = strchr(buffer + from, c);
+        return p ? (int)(p - buffer) : -1;
+    }
+    bool startsWith(const char* prefix) const {
+        size_t n = strlen(prefix);
+        return len >= n && strncmp(buffer, prefix, n) == 0;
+    }
+    LegacyString substring(unsigned from, unsigned to) const {
+        LegacyString out;
+        if (to > len) to = len;
+        if (from < to) out.copy(buffer + from, to - from);
+        return out;
+    }
+    LegacyString substring(unsigned from) const { return substring(from, len); }
+    float toFloat() const { return buffer ? atof(buffer) : 0; }
+    long toInt() const { return buffer ? atol(buffer) : 0; }
+    void trim() {
+        if (!len) return;
+        unsigned begin = 0, end = len;
+        while (begin < end && isspace(buffer[begin])) begin++;
+        while (end > begin && isspace(buffer[end - 1])) end--;
+        len = end - begin;
+        memmove(buffer, buffer + begin, len);
+        buffer[len] = '\0';
+    }
+
+private:
+    char* buffer = nullptr;
+    unsigned capacity = 0;
+    unsigned len = 0;
+};
+
+// Stream::readStringUntil('\n'): the line grows one character at a time
+static LegacyString legacyReadLine(const char* line) {
+    LegacyString out;
+    while (*line) out += *line++;
+    return out;
+}
+
+static LegacyString legacyCleanGcode(const LegacyString& src) {
+    LegacyString out;
+    out.reserve(src.length());
+    for (unsigned i = 0; i < src.length(); ) {
+        char c = src[i];
+        if ((c == 'N' || c == 'n') && i + 1 < src.length() &&
+            (isdigit(src[i + 1]) || src[i + 1] == '-')) {
+            i++;
+            while (i < src.length() && (isdigit(src[i]) || src[i] == '-')) i++;
+            if (i < src.length() && src[i] == ' ') i++;
+            continue;
+        }
+        if (c == '*') {
+            i++;
+            while (i < src.length() && isdigit(src[i])) i++;
+            continue;
+        }
+        out += c;
+        i++;
+    }
+    out.trim();
+    return out;
+}
+
+// Values are stored here so the extraction is not optimised away
+static volatile float legacySink;
+
+// The number after the letter at `index`, up to the next space, as a new string
+static LegacyString legacyWord(const LegacyString& gcode, int index) {
+    int end = gcode.indexOf(' ', index);
+    return end != -1 ? gcode.substring(index + 1, end) : gcode.substring(index + 1);
+}
+
+static void legacyCommand(const char* line) {
+    LegacyString gcode = legacyReadLine(line);
+    gcode.trim();
+    gcode = legacyCleanGcode(gcode);
+    if (gcode.startsWith("G0") || gcode.startsWith("G1")) {
+        int f = gcode.indexOf('F');
+        if (f != -1) legacySink = legacyWord(gcode, f).toInt();
+        for (char axis : {'X', 'Y', 'Z', 'E'}) {
+            int i = gcode.indexOf(axis);
+            if (i != -1) legacySink = legacyWord(gcode, i).toFloat();
+        }
+    } else {
+        int s = gcode.indexOf('S');
+        if (s != -1) legacySink = gcode.substring(s + 1).toFloat();
+    }
+}
+
+// ----- Measurement -----
+
+struct Result {
+    double seconds = 0;
+    unsigned long lines = 0;
+    unsigned long allocations = 0;
+    long peakPerLine = 0;       // largest heap growth within one line
+    unsigned long outputBytes = 0;
+};
+
+static unsigned long outputBytes = 0;
+
+static void countOutput(const char* line) {
+    outputBytes += strlen(line) + 1;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static Result runParse(const Corpus& c, int passes) {
+    Result r;
+    GcodeCommand cmd;
+    char buf[GCODE_LINE_MAX];
+    allocations = 0;
+    peakBytes = 0;
+    counting = true;
+    Clock::time_point start = Clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (const std::string& line : c.lines) {
+            strncpy(buf, line.c_str(), sizeof(buf) - 1);
+            buf[sizeof(buf) - 1] = '\0';
+            liveBytes = 0;
+            peakBytes = 0;
+            parseGcodeLine(buf, cmd);
+            if (peakBytes > r.peakPerLine) r.peakPerLine = peakBytes;
+        }
+    }
+    r.seconds = secondsSince(start);
+    counting = false;
+    r.lines = c.lines.size() * passes;
+    r.allocations = allocations;
+    return r;
+}
+
+static Result runLegacy(const Corpus& c, int passes) {
+    Result r;
+    allocations = 0;
+    counting = true;
+    Clock::time_point start = Clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (const std::string& line : c.lines) {
+            liveBytes = 0;
+            peakBytes = 0;
+            legacyCommand(line.c_str());
+            if (peakBytes > r.peakPerLine) r.peakPerLine = peakBytes;
+        }
+    }
+    r.seconds = secondsSince(start);
+    counting = false;
+    r.lines = c.lines.size() * passes;
+    r.allocations = allocations;
+    return r;
+}
+
+static Result runDispatch(const Corpus& c, int passes) {
+    Result r;
+    outputBytes = 0;
+    allocations = 0;
+    counting = true;
+    Clock::time_point start = Clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (const std::string& line : c.lines) {
+            liveBytes = 0;
+            peakBytes = 0;
+            // Stand-in for the stepper finishing the oldest move
+            if (plannerFull()) {
+                plannerCurrentBlock();
+                plannerDiscardCurrentBlock();
+            }
+            enqueueCommand(line.c_str());
+            processGcode();
+            // Dwells and waits finish at once; there is nothing to wait for
+            for (int i = 0; i < 1000 && !gcodeIdle(); i++) {
+                hostAdvance(1000);
+                processGcode();
+            }
+            if (peakBytes > r.peakPerLine) r.peakPerLine = peakBytes;
+        }
+    }
+    r.seconds = secondsSince(start);
+    counting = false;
+    r.lines = c.lines.size() * passes;
+    r.allocations = allocations;
+    r.outputBytes = outputBytes;
+    return r;
+}
+
+static void writeResult(FILE* out, const char* name, const Result& r, size_t bytesPerPass,
+                        int passes, bool last) {
+    double lines = (double)r.lines;
+    fprintf(out, "   \"%s\": {\"seconds\": %.6f, \"lines_per_s\": %.0f, \"bytes_per_s\": %.0f, "
+            "\"ns_per_line\": %.1f, \"allocations\": %lu, \"allocations_per_line\": %.4f, "
+            "\"peak_heap_per_line\": %ld, \"output_bytes_per_line\": %.2f}%s\n",
+            name, r.seconds, lines / r.seconds, (double)bytesPerPass * passes / r.seconds,
+            r.seconds * 1e9 / lines, r.allocations, r.allocations / lines, r.peakPerLine,
+            r.outputBytes / lines, last ? "" : ",");
+}
+
+int main(int argc, char** argv) {
+    int passes = 20;
+    const char* outPath = nullptr;
+    std::vector<Corpus> corpora;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) passes = atoi(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc) outPath = argv[++i];
+        else {
+            Corpus c;
+            if (!readCorpus(argv[i], c)) {
+                perror(argv[i]);
+                return 1;
+            }
+            corpora.push_back(c);
+        }
+    }
+    if (corpora.empty()) {
+        corpora.push_back(denseArcs());
+        corpora.push_back(vaseMode());
+        corpora.push_back(travelInfill());
+        corpora.push_back(numbered(corpora[0]));
+    }
+    if (passes < 1) passes = 1;
+
+    hostSerialSink = countOutput;
+    setup();
+    // Relative E as most slicers emit it, and a progress total so moves
+    // do not warn about it
+    static const char* const preamble[] = {"G90", "M83", "M290 E100000"};
+    for (const char* line : preamble) {
+        enqueueCommand(line);
+        processGcode();
+    }
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        perror(outPath);
+        return 1;
+    }
+    fprintf(out, "{\n \"benchmark\": \"gcode_throughput\",\n \"version\": 1,\n");
+    fprintf(out, " \"passes\": %d,\n \"corpora\": {\n", passes);
+    for (size_t i = 0; i < corpora.size(); i++) {
+        const Corpus& c = corpora[i];
+        // One untimed pass first so buffers in the HAL reach their size
+        runDispatch(c, 1);
+        Result legacy = runLegacy(c, passes);
+        Result parse = runParse(c, passes);
+        Result dispatch = runDispatch(c, passes);
+        fprintf(out, "  \"%s\": {\n   \"lines\": %zu,\n   \"bytes\": %zu,\n",
+                c.name.c_str(), c.lines.size(), c.bytes);
+        writeResult(out, "legacy", legacy, c.bytes, passes, false);
+        writeResult(out, "parse", parse, c.bytes, passes, false);
+        writeResult(out, "dispatch", dispatch, c.bytes, passes, true);
+        fprintf(out, "  }%s\n", i + 1 < corpora.size() ? "," : "");
+        fprintf(stderr, "%-20s %6zu lines  legacy %9.0f lines/s %6.1f allocations/line  "
+                "parse %9.0f lines/s  dispatch %9.0f lines/s  %lu allocations\n",
+                c.name.c_str(), c.lines.size(), legacy.lines / legacy.seconds,
+                (double)legacy.allocations / legacy.lines, parse.lines / parse.seconds,
+                dispatch.lines / dispatch.seconds, parse.allocations + dispatch.allocations);
+    }
+    fprintf(out, " }\n}\n");
+    if (outPath) fclose(out);
+    return 0;
+}
@@ -0,0 +1,118 @@
+#pragma once
+// Stand-in for the Arduino core when main/ is built on the host (see
+// host/README section in the top-level README). Only what the firmware
+// uses is provided. Time is virtual: micros()/millis() read a clock that
+// only moves when the runner advances it or the firmware calls delay*().
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cmath>
+#include <cstdlib>
+#include <type_traits>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define NUM_PINS 20
+
+#define F_CPU 16000000UL
+
+// Flash and RAM are the same thing here
+#define PROGMEM
+#define memcpy_P memcpy
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_float(p) (*(const float*)(p))
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+#ifndef _BV
+#define _BV(b) (1 << (b))
+#endif
+
+using std::abs;
+
+// Functions rather than the core's macros, with the same mixed-type results
+template <class A, class B>
+inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <class A, class B>
+inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+#define constrain(x, l, h) ((x) < (l) ? (l) : ((x) > (h) ? (h) : (x)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+void tone(uint8_t pin, unsigned int freq, unsigned long durationMs = 0);
+void noTone(uint8_t pin);
+
+// There is no interrupt concurrency on the host
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+char* itoa(int value, char* str, int base);
+
+class Print {
+public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const uint8_t* buf, size_t len);
+    virtual ~Print() {}
+
+    size_t print(const __FlashStringHelper* s);
+    size_t print(const char* s);
+    size_t print(char c);
+    size_t print(int v, int base = 10) { return print((long)v, base); }
+    size_t print(unsigned v, int base = 10) { return print((unsigned long)v, base); }
+    size_t print(long v, int base = 10);
+    size_t print(unsigned long v, int base = 10);
+    size_t print(double v, int digits = 2);
+
+    template <class T>
+    size_t println(T v) { size_t n = print(v); return n + println(); }
+    template <class T>
+    size_t println(T v, int arg) { size_t n = print(v, arg); return n + println(); }
+    size_t println();
+};
+
+// RX is fed by the host runner; TX goes to the runner's output
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    int peek();
+    int availableForWrite();
+    void flush() {}
+    size_t write(uint8_t c) override;
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+// Size of the UART receive ring on the AVR core
+#define SERIAL_RX_BUFFER_SIZE 64
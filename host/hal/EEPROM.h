@@ -0,0 +1,23 @@
+#pragma once
+#include <Arduino.h>
+
+#define EEPROM_SIZE 1024
+
+uint8_t* hostEepromData();
+
+struct EEPROMClass {
+    uint8_t read(int addr) { return hostEepromData()[addr]; }
+    void write(int addr, uint8_t value) { hostEepromData()[addr] = value; }
+    void update(int addr, uint8_t value) { write(addr, value); }
+    template <class T> T& get(int addr, T& t) {
+        memcpy(&t, hostEepromData() + addr, sizeof(T));
+        return t;
+    }
+    template <class T> const T& put(int addr, const T& t) {
+        memcpy(hostEepromData() + addr, &t, sizeof(T));
+        return t;
+    }
+    uint16_t length() { return EEPROM_SIZE; }
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,6 @@
+#pragma once
+#include <Arduino.h>
+
+// Handlers run from hostSetInput() when the level changes the right way
+void enableInterrupt(uint8_t pin, void (*handler)(), uint8_t mode);
+void disableInterrupt(uint8_t pin);
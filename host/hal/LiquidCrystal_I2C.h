@@ -0,0 +1,15 @@
+#pragma once
+#include <Arduino.h>
+
+// Keeps the panel contents for hostLcdRow() and counts the bytes that
+// would cross the I2C bus (one per character or command)
+class LiquidCrystal_I2C : public Print {
+public:
+    LiquidCrystal_I2C(uint8_t addr, uint8_t cols, uint8_t rows);
+    void init();
+    void backlight() {}
+    void clear();
+    void setCursor(uint8_t col, uint8_t row);
+    size_t write(uint8_t c) override;
+    using Print::write;
+};
@@ -0,0 +1,299 @@
+#include "host.h"
+#include <EEPROM.h>
+#include <EnableInterrupt.h>
+#include <LiquidCrystal_I2C.h>
+#include <stdio.h>
+#include <deque>
+#include <string>
+
+// ----- Virtual clock -----
+
+static uint64_t nowUs = 0;
+// Clock reads since the runner last advanced time. Past BUSY_READS the
+// firmware is spinning on the clock (e.g. waiting for planner space) and
+// each read costs a microsecond, as the time the interrupts take would.
+static const unsigned BUSY_READS = 256;
+static unsigned readsSinceAdvance = 0;
+
+static uint64_t readClock() {
+    if (++readsSinceAdvance > BUSY_READS) nowUs++;
+    return nowUs;
+}
+
+uint64_t hostMicros() { return nowUs; }
+void hostAdvance(uint64_t us) {
+    nowUs += us;
+    readsSinceAdvance = 0;
+}
+
+unsigned long micros() { return (unsigned long)readClock(); }
+unsigned long millis() { return (unsigned long)(readClock() / 1000); }
+void delay(unsigned long ms) { nowUs += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { nowUs += us; }
+
+// ----- Pins -----
+
+HostPinHook hostPinHook = nullptr;
+static uint8_t pinLevel[NUM_PINS];
+static unsigned long pinWrites[NUM_PINS];
+static int analogIn[NUM_PINS];
+static int analogOut[NUM_PINS];
+static unsigned int toneFreq = 0;
+
+struct PinInterrupt {
+    void (*handler)();
+    uint8_t mode;
+};
+static PinInterrupt pinInterrupts[NUM_PINS];
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin < NUM_PINS && mode == INPUT_PULLUP) pinLevel[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+    if (pin >= NUM_PINS) return;
+    pinWrites[pin]++;
+    level = level ? HIGH : LOW;
+    if (pinLevel[pin] == level) return;
+    pinLevel[pin] = level;
+    if (hostPinHook) hostPinHook(pin, level, nowUs);
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < NUM_PINS ? pinLevel[pin] : LOW;
+}
+
+int analogRead(uint8_t pin) {
+    if (pin < A0) pin += A0;
+    return pin < NUM_PINS ? analogIn[pin] : 0;
+}
+
+void analogWrite(uint8_t pin, int value) {
+    if (pin < NUM_PINS) analogOut[pin] = value;
+}
+
+void tone(uint8_t, unsigned int freq, unsigned long) { toneFreq = freq; }
+void noTone(uint8_t) { toneFreq = 0; }
+
+uint8_t hostPinLevel(uint8_t pin) { return pin < NUM_PINS ? pinLevel[pin] : LOW; }
+unsigned long hostPinWrites(uint8_t pin) { return pin < NUM_PINS ? pinWrites[pin] : 0; }
+int hostAnalogOutput(uint8_t pin) { return pin < NUM_PINS ? analogOut[pin] : 0; }
+unsigned int hostToneFrequency() { return toneFreq; }
+
+void hostSetAnalog(uint8_t pin, int value) {
+    if (pin < A0) pin += A0;
+    if (pin < NUM_PINS) analogIn[pin] = value;
+}
+
+void hostSetInput(uint8_t pin, uint8_t level) {
+    if (pin >= NUM_PINS) return;
+    level = level ? HIGH : LOW;
+    uint8_t old = pinLevel[pin];
+    pinLevel[pin] = level;
+    const PinInterrupt& pi = pinInterrupts[pin];
+    if (!pi.handler || old == level) return;
+    if (pi.mode == CHANGE || (pi.mode == FALLING && level == LOW) ||
+        (pi.mode == RISING && level == HIGH)) {
+        pi.handler();
+    }
+}
+
+void enableInterrupt(uint8_t pin, void (*handler)(), uint8_t mode) {
+    if (pin < NUM_PINS) pinInterrupts[pin] = {handler, mode};
+}
+
+void disableInterrupt(uint8_t pin) {
+    if (pin < NUM_PINS) pinInterrupts[pin] = {nullptr, 0};
+}
+
+// ----- Print -----
+
+size_t Print::write(const uint8_t* buf, size_t len) {
+    for (size_t i = 0; i < len; i++) write(buf[i]);
+    return len;
+}
+
+size_t Print::print(const __FlashStringHelper* s) {
+    return print(reinterpret_cast<const char*>(s));
+}
+
+size_t Print::print(const char* s) {
+    return write((const uint8_t*)s, strlen(s));
+}
+
+size_t Print::print(char c) {
+    return write((uint8_t)c);
+}
+
+size_t Print::print(long v, int base) {
+    if (base == 10) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), "%ld", v);
+        return print(buf);
+    }
+    return print((unsigned long)v, base);
+}
+
+size_t Print::print(unsigned long v, int base) {
+    char buf[66];
+    char* p = buf + sizeof(buf) - 1;
+    *p = '\0';
+    if (base < 2) base = 10;
+    do {
+        int d = v % base;
+        *--p = d < 10 ? '0' + d : 'A' + d - 10;
+        v /= base;
+    } while (v);
+    return print(p);
+}
+
+size_t Print::print(double v, int digits) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, v);
+    return print(buf);
+}
+
+size_t Print::println() {
+    return print("\r\n");
+}
+
+char* itoa(int value, char* str, int base) {
+    if (base == 10) {
+        sprintf(str, "%d", value);
+        return str;
+    }
+    char buf[34];
+    char* p = buf + sizeof(buf) - 1;
+    unsigned v = (unsigned)value;
+    *p = '\0';
+    do {
+        int d = v % base;
+        *--p = d < 10 ? '0' + d : 'a' + d - 10;
+        v /= base;
+    } while (v);
+    strcpy(str, p);
+    return str;
+}
+
+// ----- Serial -----
+
+HardwareSerial Serial;
+HostSerialSink hostSerialSink = nullptr;
+
+static uint64_t byteTimeUs = 87;        // 115200 baud, 10 bits per byte
+static uint64_t nextByteAt = 0;
+static std::deque<char> serialPending;  // sent by the host, still on the wire
+static std::deque<char> serialRx;       // in the UART ring
+static std::string serialLine;
+
+// Move the bytes that have finished arriving into the RX ring. The ring
+// holds 63 bytes like the AVR core's; while it is full the wire waits
+// instead of dropping, as if the host paced itself.
+static void receiveBytes() {
+    while (!serialPending.empty() && nowUs >= nextByteAt &&
+           serialRx.size() < SERIAL_RX_BUFFER_SIZE - 1) {
+        serialRx.push_back(serialPending.front());
+        serialPending.pop_front();
+        nextByteAt += byteTimeUs;
+    }
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+    byteTimeUs = (10000000UL + baud / 2) / baud;
+}
+
+int HardwareSerial::available() {
+    receiveBytes();
+    return (int)serialRx.size();
+}
+
+int HardwareSerial::read() {
+    receiveBytes();
+    if (serialRx.empty()) return -1;
+    char c = serialRx.front();
+    serialRx.pop_front();
+    return (uint8_t)c;
+}
+
+int HardwareSerial::peek() {
+    receiveBytes();
+    return serialRx.empty() ? -1 : (uint8_t)serialRx.front();
+}
+
+int HardwareSerial::availableForWrite() {
+    return 63;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    if (c == '\r') return 1;
+    if (c != '\n') {
+        serialLine += (char)c;
+        return 1;
+    }
+    if (hostSerialSink) {
+        hostSerialSink(serialLine.c_str());
+    } else {
+        puts(serialLine.c_str());
+    }
+    serialLine.clear();
+    return 1;
+}
+
+void hostSerialSend(const char* data, size_t len) {
+    if (serialPending.empty() && nextByteAt < nowUs) nextByteAt = nowUs + byteTimeUs;
+    serialPending.insert(serialPending.end(), data, data + len);
+}
+
+size_t hostSerialPending() {
+    receiveBytes();
+    return serialPending.size() + serialRx.size();
+}
+
+// ----- LCD -----
+
+static char lcdRows[2][17];
+static uint8_t lcdCol = 0, lcdRow = 0;
+static unsigned long lcdBytes = 0;
+
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t, uint8_t, uint8_t) {}
+
+void LiquidCrystal_I2C::init() {
+    clear();
+}
+
+void LiquidCrystal_I2C::clear() {
+    memset(lcdRows, ' ', sizeof(lcdRows));
+    lcdRows[0][16] = lcdRows[1][16] = '\0';
+    lcdCol = lcdRow = 0;
+    lcdBytes++;
+}
+
+void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row) {
+    lcdCol = col;
+    lcdRow = row < 2 ? row : 1;
+    lcdBytes++;
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t c) {
+    if (lcdCol < 16) lcdRows[lcdRow][lcdCol] = (char)c;
+    lcdCol++;
+    lcdBytes++;
+    return 1;
+}
+
+const char* hostLcdRow(uint8_t row) { return lcdRows[row < 2 ? row : 1]; }
+unsigned long hostLcdBytes() { return lcdBytes; }
+
+// ----- EEPROM -----
+
+EEPROMClass EEPROM;
+static uint8_t eepromData[EEPROM_SIZE];
+static bool eepromErased = false;
+
+uint8_t* hostEepromData() {
+    if (!eepromErased) {
+        memset(eepromData, 0xFF, sizeof(eepromData));
+        eepromErased = true;
+    }
+    return eepromData;
+}
@@ -0,0 +1,36 @@
+#pragma once
+// Control side of the host HAL, used by the runner and benchmarks: the
+// virtual clock, pin state and the serial/LCD/EEPROM stand-ins.
+#include <Arduino.h>
+
+// Virtual time in microseconds since start; micros() is its low bits
+uint64_t hostMicros();
+void hostAdvance(uint64_t us);
+
+// Every digitalWrite() is counted; the hook (if set) sees each change of
+// level with the virtual time, e.g. to follow step pulses
+typedef void (*HostPinHook)(uint8_t pin, uint8_t level, uint64_t us);
+extern HostPinHook hostPinHook;
+uint8_t hostPinLevel(uint8_t pin);
+unsigned long hostPinWrites(uint8_t pin);
+
+// Drive an input pin; fires an EnableInterrupt handler on a matching edge
+void hostSetInput(uint8_t pin, uint8_t level);
+void hostSetAnalog(uint8_t pin, int value);
+int hostAnalogOutput(uint8_t pin);
+unsigned int hostToneFrequency();
+
+// Serial: bytes queued here reach Serial.read() once the UART would have
+// received them at the configured baud rate, as long as the 64-byte RX
+// ring has room. Output is passed to the sink line by line.
+void hostSerialSend(const char* data, size_t len);
+size_t hostSerialPending();
+typedef void (*HostSerialSink)(const char* line);
+extern HostSerialSink hostSerialSink;
+
+// LCD contents and the number of bytes sent to the panel
+const char* hostLcdRow(uint8_t row);
+unsigned long hostLcdBytes();
+
+// Raw EEPROM image (1 KB, erased to 0xFF at start)
+uint8_t* hostEepromData();
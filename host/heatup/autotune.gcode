@@ -0,0 +1,11 @@
+; M303 relay autotune at 200 C with U1, so the reported Ziegler-Nichols
+; gains are applied; then a cool-down and a heat-up back to 200 C and four
+; minutes of hold with those gains
+; expect: rise<=50 overshoot<=1.0 settle<=85 errors=0
+M306 S0
+M303 S200 C5 U1
+G4 S400
+; not allowed while the dwell runs, so the M104 below waits for it
+G92 E0
+M104 S200
+G4 S240
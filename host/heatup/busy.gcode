@@ -0,0 +1,8 @@
+; M109 holds the queue while it heats and the move behind it waits; the
+; M105 queued behind the move must still be answered before the target is
+; reached. The dwell keeps the run going until the heat-up is reported.
+; expect: rise<=55 overshoot<=1.0 reports=1 errors=0
+M109 S200
+G1 X1
+M105
+G4 S120
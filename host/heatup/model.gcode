@@ -0,0 +1,5 @@
+; Heat-up from 25 C to 200 C with model control, then four minutes of hold
+; expect: rise<=55 overshoot<=1.0 settle<=70 errors=0
+M306 S1
+M104 S200
+G4 S240
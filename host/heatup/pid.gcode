@@ -0,0 +1,5 @@
+; The same heat-up and hold with the default PID gains, as the baseline
+; expect: rise<=55 overshoot<=1.0 settle<=85 errors=0
+M306 S0
+M104 S200
+G4 S240
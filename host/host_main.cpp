@@ -0,0 +1,148 @@
+// Runs the firmware from main/ on the host: setup(), then loop() with the
+// virtual clock advanced a fixed amount per pass. G-code from a file or
+// stdin is sent like a simple host program does, a line at a time (or up
+// to -w lines ahead) and the next one after each "ok". Step pulses move a
+// model of the axes, whose endstops close at 0 mm, so G28 works. -r
+// records every step/dir edge to a trace (see trace.h). -b presses the
+// button the given number of seconds after each pause starts, so a run
+// resumes after a crash stop.
+//
+//   firmware_host [-t seconds] [-w window] [-l loop_us] [-b seconds] [-r trace.bin] [file.gcode]
+#include "host.h"
+#include "pins.h"
+#include "planner.h"
+#include "gcode.h"
+#include "state.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+void setup();
+void loop();
+
+// Where the carriage starts, ahead of the endstops
+static const float START_MM = 20.0f;
+
+static const uint8_t stepPins[AXIS_COUNT] = {STEP_PIN_X, STEP_PIN_Y, STEP_PIN_Z, STEP_PIN_E};
+static const uint8_t dirPins[AXIS_COUNT] = {DIR_PIN_X, DIR_PIN_Y, DIR_PIN_Z, DIR_PIN_E};
+static const uint8_t endstopPins[3] = {ENDSTOP_PIN_X, ENDSTOP_PIN_Y, ENDSTOP_PIN_Z};
+static long carriage[AXIS_COUNT];   // steps from the endstop
+static unsigned long stepCount[AXIS_COUNT];
+static int outstanding = 0;         // lines sent and not yet acknowledged
+static uint64_t resumeDelayUs = 0;  // -b; 0 leaves a pause standing
+static uint64_t pausedAt = 0;       // when the current pause was first seen
+static uint64_t releaseAt = 0;      // when the pressed button is let go
+
+static void onPin(uint8_t pin, uint8_t level, uint64_t) {
+    // Step and dir pins only change inside the simulated step interrupt
+    traceEdge(pin, level, stepperTimerTicks());
+    if (level != HIGH) return;
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        if (pin != stepPins[a]) continue;
+        // startBlock() drives DIR high for the positive direction
+        carriage[a] += hostPinLevel(dirPins[a]) ? 1 : -1;
+        stepCount[a]++;
+        if (a < 3) hostSetInput(endstopPins[a], carriage[a] > 0 ? HIGH : LOW);
+    }
+}
+
+static void onSerialLine(const char* line) {
+    if (strncmp(line, "ok", 2) == 0 && outstanding > 0) outstanding--;
+    puts(line);
+}
+
+// The operator presses the button a while after the firmware pauses and
+// lets go 0.1 s later
+static void serviceButton() {
+    uint64_t now = hostMicros();
+    if (releaseAt && now >= releaseAt) {
+        hostSetInput(buttonPin, HIGH);
+        releaseAt = 0;
+    }
+    if (!printer.paused) {
+        pausedAt = 0;
+        return;
+    }
+    if (!pausedAt) {
+        pausedAt = now;
+    } else if (!releaseAt && now - pausedAt >= resumeDelayUs) {
+        hostSetInput(buttonPin, LOW);
+        releaseAt = now + 100000;
+    }
+}
+
+static bool readLines(FILE* in, std::vector<std::string>& lines) {
+    char buf[256];
+    while (fgets(buf, sizeof(buf), in)) {
+        std::string line(buf);
+        if (line.empty() || line.back() != '\n') line += '\n';
+        lines.push_back(line);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    double limitSeconds = 3600.0;
+    int window = 1;
+    unsigned loopUs = 50;
+    const char* path = nullptr;
+    const char* tracePath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc) limitSeconds = atof(argv[++i]);
+        else if (arg == "-w" && i + 1 < argc) window = atoi(argv[++i]);
+        else if (arg == "-l" && i + 1 < argc) loopUs = (unsigned)atoi(argv[++i]);
+        else if (arg == "-b" && i + 1 < argc) resumeDelayUs = (uint64_t)(atof(argv[++i]) * 1e6);
+        else if (arg == "-r" && i + 1 < argc) tracePath = argv[++i];
+        else path = argv[i];
+    }
+
+    FILE* in = path ? fopen(path, "r") : stdin;
+    if (!in) {
+        perror(path);
+        return 1;
+    }
+    std::vector<std::string> lines;
+    readLines(in, lines);
+    if (path) fclose(in);
+
+    hostSerialSink = onSerialLine;
+    hostPinHook = onPin;
+    setup();
+    for (uint8_t a = 0; a < 3; a++) {
+        carriage[a] = lroundf(START_MM * axisStepsPerMM(a));
+        hostSetInput(endstopPins[a], HIGH);
+    }
+    // After setup() so the header has the steps/mm loaded from EEPROM
+    if (tracePath && !traceOpen(tracePath)) {
+        perror(tracePath);
+        return 1;
+    }
+
+    size_t next = 0;
+    uint64_t limitUs = (uint64_t)(limitSeconds * 1e6);
+    while (hostMicros() < limitUs) {
+        while (next < lines.size() && outstanding < window) {
+            hostSerialSend(lines[next].data(), lines[next].size());
+            outstanding++;
+            next++;
+        }
+        loop();
+        hostAdvance(loopUs);
+        if (resumeDelayUs) serviceButton();
+        if (next == lines.size() && outstanding == 0 && !hostSerialPending() &&
+            gcodeIdle() && plannerEmpty()) {
+            break;
+        }
+    }
+
+    fprintf(stderr, "host: %.3f s virtual, %zu/%zu lines, steps X:%lu Y:%lu Z:%lu E:%lu\n",
+            hostMicros() / 1e6, next, lines.size(),
+            stepCount[AXIS_X], stepCount[AXIS_Y], stepCount[AXIS_Z], stepCount[AXIS_E]);
+    if (tracePath) {
+        fprintf(stderr, "host: trace %lu edges, %lu bytes\n", traceEdges(), traceBytes());
+        traceClose();
+    }
+    return next == lines.size() && outstanding == 0 ? 0 : 2;
+}
@@ -0,0 +1,48 @@
+// Checks the compile-time thermistor table against the B-equation (or the
+// Steinhart-Hart equation for THERMISTOR_TYPE 99) evaluated with log() at
+// run time, for every oversampled reading thermistorDeciCelsius() accepts
+// that lies in the checked temperature range. Fails when an interpolated
+// value there is off by more than the tolerance. The default range covers
+// room temperature up to the 300 degC the heater may be set to; the table
+// is coarser towards its clamped ends.
+//
+//   thermistor_test [tolerance degC, default 1.0] [min degC, default 0] [max degC, default 300]
+#include "thermistor.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static double analyticCelsius(double r) {
+#if THERMISTOR_TYPE == 99
+    double ln = log(r);
+    return 1.0 / (THERMISTOR_SH_A + THERMISTOR_SH_B * ln + THERMISTOR_SH_C * ln * ln * ln) - 273.15;
+#else
+    return 1.0 / (log(r / THERMISTOR_NOMINAL) / BCOEFFICIENT +
+                  1.0 / (TEMPERATURE_NOMINAL + 273.15)) - 273.15;
+#endif
+}
+
+int main(int argc, char** argv) {
+    double tolerance = argc > 1 ? atof(argv[1]) : 1.0;
+    double minC = argc > 2 ? atof(argv[2]) : 0.0;
+    double maxC = argc > 3 ? atof(argv[3]) : 300.0;
+    double worst = 0;
+    uint16_t worstAdc = 0;
+    int checked = 0;
+    // Readings of 0 and 1023 are an open or shorted sensor, not a temperature
+    for (uint16_t adc16 = 16; adc16 < 1023 * 16; adc16++) {
+        double raw = adc16 / 16.0;
+        double want = analyticCelsius(SERIES_RESISTOR * (1023 - raw) / raw);
+        if (want < minC || want > maxC) continue;
+        double got = thermistorDeciCelsius(adc16) / 10.0;
+        double error = fabs(got - want);
+        if (error > worst) {
+            worst = error;
+            worstAdc = adc16;
+        }
+        checked++;
+    }
+    printf("thermistor type %d: %d readings in %.0f..%.0f degC, max error %.3f degC at ADC %.4f "
+           "(tolerance %.3f)\n", THERMISTOR_TYPE, checked, minC, maxC, worst, worstAdc / 16.0, tolerance);
+    return worst <= tolerance ? 0 : 1;
+}
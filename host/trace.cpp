@@ -0,0 +1,76 @@
+#include "trace.h"
+#include "host.h"
+#include "pins.h"
+#include "planner.h"
+#include <stdio.h>
+
+static const uint8_t TRACE_VERSION = 1;
+static const char axisLetters[] = "XYZE";
+static const uint8_t stepPins[AXIS_COUNT] = {STEP_PIN_X, STEP_PIN_Y, STEP_PIN_Z, STEP_PIN_E};
+static const uint8_t dirPins[AXIS_COUNT] = {DIR_PIN_X, DIR_PIN_Y, DIR_PIN_Z, DIR_PIN_E};
+
+static FILE* traceFile = nullptr;
+static uint64_t lastTicks = 0;
+static unsigned long edges = 0;
+static unsigned long bytes = 0;
+
+static void put(const void* data, size_t len) {
+    fwrite(data, 1, len, traceFile);
+    bytes += len;
+}
+
+static void putByte(uint8_t b) {
+    put(&b, 1);
+}
+
+bool traceOpen(const char* path) {
+    traceFile = fopen(path, "wb");
+    if (!traceFile) return false;
+    put("STRC", 4);
+    putByte(TRACE_VERSION);
+    uint32_t hz = STEPPER_TIMER_HZ;
+    put(&hz, sizeof(hz));
+    putByte(AXIS_COUNT);
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        putByte(axisLetters[a]);
+        putByte(stepPins[a]);
+        putByte(dirPins[a]);
+        float spm = axisStepsPerMM(a);
+        put(&spm, sizeof(spm));
+    }
+    // Dir pins that are already set produce no edge, so record them up front
+    uint64_t now = lastTicks;
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        traceEdge(dirPins[a], hostPinLevel(dirPins[a]), now);
+    }
+    return true;
+}
+
+void traceEdge(uint8_t pin, uint8_t level, uint64_t ticks) {
+    if (!traceFile) return;
+    uint8_t code = 0xFF;
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        if (pin == stepPins[a]) code = a;
+        else if (pin == dirPins[a]) code = a | 0x04;
+    }
+    if (code == 0xFF) return;
+    if (level) code |= 0x08;
+
+    uint64_t delta = ticks - lastTicks;
+    lastTicks = ticks;
+    do {
+        uint8_t b = delta & 0x7F;
+        delta >>= 7;
+        putByte(delta ? (b | 0x80) : b);
+    } while (delta);
+    putByte(code);
+    edges++;
+}
+
+unsigned long traceEdges() { return edges; }
+unsigned long traceBytes() { return bytes; }
+
+void traceClose() {
+    if (traceFile) fclose(traceFile);
+    traceFile = nullptr;
+}
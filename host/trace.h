@@ -0,0 +1,21 @@
+#pragma once
+// Step/dir edge recorder for the host runner (-r). The trace is read back
+// by tools/steptrace.py.
+//
+// Format, little-endian:
+//   "STRC", version (u8), timer rate in Hz (u32), axis count (u8), then
+//   per axis: letter (char), step pin (u8), dir pin (u8), steps/mm (f32).
+//   Records follow to the end of the file: the ticks since the previous
+//   record as an unsigned LEB128 varint, then one byte with the axis in
+//   bits 0-1, bit 2 set for a dir edge, and the new level in bit 3.
+// The first records give every dir pin's level when the trace was opened.
+// A high dir pin means the positive direction.
+#include <stdint.h>
+
+bool traceOpen(const char* path);
+// Records the edge if `pin` is a step or dir pin; `ticks` is absolute
+void traceEdge(uint8_t pin, uint8_t level, uint64_t ticks);
+// Edges recorded so far and the bytes they took
+unsigned long traceEdges();
+unsigned long traceBytes();
+void traceClose();
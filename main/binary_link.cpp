@@ -0,0 +1,150 @@
+#include "binary_link.h"
+#include "serial_rx.h"
+#include "motion.h"
+#include "planner.h"
+
+extern float feedrateMultiplier;
+extern int currentFeedrate;
+
+bool binaryLinkActive = false;
+
+enum FrameState : uint8_t {
+    FRAME_SYNC,
+    FRAME_TYPE,
+    FRAME_SEQ,
+    FRAME_LEN,
+    FRAME_PAYLOAD,
+    FRAME_CRC_LO,
+    FRAME_CRC_HI
+};
+
+static FrameState frameState = FRAME_SYNC;
+static uint8_t frameType;
+static uint8_t frameSeq;
+static uint8_t frameLen;
+static uint8_t frameFill;
+static uint16_t frameCrc;
+static uint16_t receivedCrc;
+static uint8_t expectedSeq = 0;
+// Marker byte plus the largest payload a queue slot can hold
+static uint8_t frame[GCODE_LINE_MAX];
+
+uint16_t crc16Update(uint16_t crc, uint8_t data) {
+    crc ^= (uint16_t)data << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+void binaryLinkBegin() {
+    frameState = FRAME_SYNC;
+    expectedSeq = 0;
+    binaryLinkActive = true;
+}
+
+static void requestResend() {
+    Serial.print(F("rs N"));
+    Serial.println(expectedSeq);
+}
+
+static void frameComplete() {
+    if (receivedCrc != frameCrc) {
+        Serial.println(F("Error:Frame CRC"));
+        requestResend();
+        return;
+    }
+    if (frameSeq != expectedSeq) {
+        // The host resent a frame whose "ok" it missed: acknowledge again
+        if ((uint8_t)(frameSeq + 1) == expectedSeq) sendLineAck(frameSeq);
+        else requestResend();
+        return;
+    }
+
+    if (frameType == BINARY_FRAME_MOVE) {
+        uint8_t axes = 0;
+        for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+            if (frameLen && (frame[1] & _BV(a))) axes++;
+        }
+        if (frameLen == 1 + 4 * axes + 2) {
+            frame[0] = BINARY_MOVE_MARKER;
+            enqueueCommandBytes(frame, frameLen + 1);
+        } else {
+            Serial.println(F("Error:Bad move frame"));
+        }
+    } else if (frameType == BINARY_FRAME_GCODE) {
+        frame[frameLen + 1] = '\0';
+        enqueueCommand((const char*)frame + 1);
+    }
+    expectedSeq++;
+    sendLineAck(frameSeq);
+    if (frameType == BINARY_FRAME_EXIT) {
+        binaryLinkActive = false;
+        Serial.println(F("echo:Binary mode off"));
+    }
+}
+
+void binaryLinkFeed(uint8_t c) {
+    switch (frameState) {
+        case FRAME_SYNC:
+            if (c == BINARY_SYNC) {
+                frameCrc = 0xFFFF;
+                frameState = FRAME_TYPE;
+            }
+            return;
+        case FRAME_TYPE:
+            frameType = c;
+            frameState = FRAME_SEQ;
+            break;
+        case FRAME_SEQ:
+            frameSeq = c;
+            frameState = FRAME_LEN;
+            break;
+        case FRAME_LEN:
+            frameLen = c;
+            frameFill = 0;
+            if (frameLen > sizeof(frame) - 2) {
+                // Cannot be a valid frame; resynchronise on the next sync byte
+                frameState = FRAME_SYNC;
+                requestResend();
+                return;
+            }
+            frameState = frameLen ? FRAME_PAYLOAD : FRAME_CRC_LO;
+            break;
+        case FRAME_PAYLOAD:
+            frame[1 + frameFill++] = c;
+            if (frameFill == frameLen) frameState = FRAME_CRC_LO;
+            break;
+        case FRAME_CRC_LO:
+            receivedCrc = c;
+            frameState = FRAME_CRC_HI;
+            return;
+        case FRAME_CRC_HI:
+            receivedCrc |= (uint16_t)c << 8;
+            frameState = FRAME_SYNC;
+            frameComplete();
+            return;
+    }
+    frameCrc = crc16Update(frameCrc, c);
+}
+
+static long readLong(const uint8_t* p) {
+    return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                  ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+void runBinaryMove(const uint8_t* payload) {
+    uint8_t mask = *payload++;
+    long target[AXIS_COUNT];
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        if (mask & _BV(a)) {
+            target[a] = readLong(payload);
+            payload += 4;
+        } else {
+            target[a] = plannerPosition(a);
+        }
+    }
+    uint16_t feedrate = payload[0] | ((uint16_t)payload[1] << 8);
+    if (feedrate) currentFeedrate = feedrate;
+    moveToSteps(target, currentFeedrate * feedrateMultiplier);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+
+// Framed binary move protocol, enabled with M880 S1.
+//
+//   0xA5 | type | seq | len | payload[len] | crc16 (little endian)
+//
+// The CRC is CRC-16/CCITT-FALSE over type, seq, len and payload. Every
+// good frame is acknowledged like a text line ("ok N<seq> ..."); a damaged
+// or out-of-order frame gets "rs N<seq>" naming the frame to resend.
+#define BINARY_SYNC         0xA5
+#define BINARY_FRAME_MOVE   0x01  // axis mask, int32 step targets, uint16 mm/min
+#define BINARY_FRAME_GCODE  0x02  // one G-code line as text
+#define BINARY_FRAME_EXIT   0x03  // back to text G-code after this frame
+
+// First byte of a command queue slot holding a decoded move frame; text
+// lines never start with a control character
+#define BINARY_MOVE_MARKER  0x01
+
+extern bool binaryLinkActive;
+
+void binaryLinkBegin();
+
+// Feed one received byte while binaryLinkActive
+void binaryLinkFeed(uint8_t c);
+
+// Run a move frame payload stored in the command queue
+void runBinaryMove(const uint8_t* payload);
+
+uint16_t crc16Update(uint16_t crc, uint8_t data);
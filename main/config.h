@@ -14,3 +14,23 @@
 
 // Uncomment to enable verbose serial logging from readTemperature()
 //#define DEBUG_LOGS
+
+// Step pulse width in microseconds; A4988 needs >= 1 us, DRV8825 >= 2 us
+#define STEP_PULSE_US 2
+
+// Homing (G28): fast approach at HOMING_FEEDRATE_XY/Z mm/min over at most
+// HOMING_MAX_TRAVEL mm, back off HOMING_BUMP mm, then re-probe at
+// 1/HOMING_SLOW_DIVISOR of the speed. X and Y home together, Z after them.
+#define HOMING_FEEDRATE_XY  3000
+#define HOMING_FEEDRATE_Z   600
+#define HOMING_MAX_TRAVEL   250
+#define HOMING_BUMP         3
+#define HOMING_SLOW_DIVISOR 4
+
+// Acknowledge queued lines as "ok N<line> P<free blocks> B<free slots>" so
+// hosts can stream ahead; comment out for a plain "ok"
+#define ADVANCED_OK
+
+// Thermistor model, see thermistor.h (1 = 100k B3950). For 99 also define
+// THERMISTOR_SH_A, THERMISTOR_SH_B and THERMISTOR_SH_C (Steinhart-Hart)
+#define THERMISTOR_TYPE 1
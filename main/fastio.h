@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+
+// Direct port access for pins known at compile time. FastPin<2>::high()
+// compiles to a single sbi on the UNO/Nano instead of digitalWrite()'s
+// pin-table lookup. Other boards fall back to the Arduino calls.
+
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)
+#define FASTIO_DIRECT
+
+// D0-D7 -> PORTD, D8-D13 -> PORTB, A0-A5 (14-19) -> PORTC.
+// Values are data-space addresses of the PORTx registers; PINx and DDRx
+// sit two and one bytes below.
+constexpr uint8_t fastPortAddr(uint8_t pin) {
+    return pin < 8 ? 0x2B : (pin < 14 ? 0x25 : 0x28);
+}
+
+constexpr uint8_t fastPinBit(uint8_t pin) {
+    return pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14);
+}
+
+template <uint8_t PIN>
+struct FastPin {
+    static_assert(PIN < 20, "pin is not available on this board");
+    static constexpr uint8_t portAddr = fastPortAddr(PIN);
+    static constexpr uint8_t mask = 1 << fastPinBit(PIN);
+
+    static inline volatile uint8_t& port() { return *reinterpret_cast<volatile uint8_t*>(portAddr); }
+    static inline volatile uint8_t& in() { return *reinterpret_cast<volatile uint8_t*>(portAddr - 2); }
+    static inline volatile uint8_t& ddr() { return *reinterpret_cast<volatile uint8_t*>(portAddr - 1); }
+
+    static inline void high() { port() |= mask; }
+    static inline void low() { port() &= (uint8_t)~mask; }
+    static inline void write(bool level) { if (level) high(); else low(); }
+    static inline bool read() { return (in() & mask) != 0; }
+    static inline void output() { ddr() |= mask; }
+};
+
+#else
+
+template <uint8_t PIN>
+struct FastPin {
+    static inline void high() { digitalWrite(PIN, HIGH); }
+    static inline void low() { digitalWrite(PIN, LOW); }
+    static inline void write(bool level) { digitalWrite(PIN, level ? HIGH : LOW); }
+    static inline bool read() { return digitalRead(PIN) == HIGH; }
+    static inline void output() { pinMode(PIN, OUTPUT); }
+};
+
+#endif
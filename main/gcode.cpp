@@ -2,34 +2,29 @@
 #include "gcode.h"
 #include "tunes.h"
 #include "state.h"
-#include <LiquidCrystal_I2C.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 #include <ctype.h>
 #include "config.h"
+#include "planner.h"
+#include "parser.h"
+#include "serial_rx.h"
+#include "binary_link.h"
+#include "temp_control.h"
+#include "scheduler.h"
+#include "interrupts.h"
 
-// Unified serial response helpers
-void sendOk(const __FlashStringHelper* msg) {
-    Serial.print(F("ok"));
-    if (msg) {
-        Serial.print(' ');
-        Serial.print(msg);
-    }
-    Serial.println();
-}
-
-void sendOk(const char* msg) {
-    Serial.print(F("ok"));
-    if (msg && msg[0]) {
-        Serial.print(' ');
-        Serial.print(msg);
-    }
-    Serial.println();
+// Unified serial response helpers. Lines are acknowledged with "ok" when
+// they are queued, so handler output must not start with "ok" itself.
+void sendReply(const __FlashStringHelper* msg) {
+    Serial.print(F("echo:"));
+    Serial.println(msg);
 }
 
-void sendOk() {
-    Serial.println(F("ok"));
+void sendReply(const char* msg) {
+    Serial.print(F("echo:"));
+    Serial.println(msg);
 }
 
 // 外部變數宣告
@@ -46,9 +41,6 @@ extern void playTune(int tune);
 extern void saveSettingsToEEPROM();
 extern void updateProgress();
 extern float stepsPerMM_X, stepsPerMM_Y, stepsPerMM_Z, stepsPerMM_E;
-extern LiquidCrystal_I2C lcd;
-extern char lastDisplayContent[33];
-extern void showMessage(const char*, const char*);
 
 #ifdef SIMULATE_GCODE_INPUT
 static const char *debugCommands[] = {
@@ -67,398 +59,626 @@ static const int debugCommandCount = sizeof(debugCommands) / sizeof(debugCommand
 static int debugIndex = 0;
 #endif
 
-static String getGcodeInput() {
+static GcodeCommand cmd;
+static const char axisLetters[] = "XYZE";  // G-code letter per Axis
+
+// Oldest queued line, or nullptr if none is waiting
+static char* getGcodeInput() {
 #ifdef SIMULATE_GCODE_INPUT
-    if (debugIndex < debugCommandCount) {
-        String cmd(debugCommands[debugIndex++]);
+    if (debugIndex < debugCommandCount && enqueueCommand(debugCommands[debugIndex])) {
         Serial.print(F("DBG> "));
-        Serial.println(cmd);
-        return cmd;
+        Serial.println(debugCommands[debugIndex++]);
     }
 #endif
-    if (Serial.available()) {
-        return Serial.readStringUntil('\n');
-    }
-    return String();
+    return commandQueuePeek();
 }
 
-static bool isDigitChar(char c) {
-    return c >= '0' && c <= '9';
-}
+static void handleMoveCommand(const GcodeCommand &gcode, bool allowExtrude) {
+    if (gcode.has('F')) {
+        long parsed = gcode.longValue('F');
+        if (parsed > 0) currentFeedrate = parsed;
+    }
 
-// Remove line numbers (Nxxx) and checksums (*xxx) from a raw G-code line
-static String cleanGcode(const String &src) {
-    String out;
-    out.reserve(src.length());
-    for (size_t i = 0; i < src.length(); ) {
-        char c = src[i];
-        if ((c == 'N' || c == 'n') && i + 1 < src.length() &&
-            (isDigitChar(src[i + 1]) || src[i + 1] == '-')) {
-            i++;
-            while (i < src.length() && (isDigitChar(src[i]) || src[i] == '-')) i++;
-            if (i < src.length() && src[i] == ' ') i++;
+    bool relativeXYZ = !useAbsoluteXYZ;
+    bool relativeE = useRelativeE || relativeXYZ;
+    long target[AXIS_COUNT];
+    bool given[AXIS_COUNT];
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        char letter = axisLetters[a];
+        given[a] = gcode.has(letter) && (a != AXIS_E || allowExtrude);
+        if (!given[a]) {
+            target[a] = plannerPosition(a);
             continue;
         }
-        if (c == '*') {
-            i++;
-            while (i < src.length() && isDigitChar(src[i])) i++;
-            continue;
+        float value = gcode.value(letter);
+        bool relative = (a == AXIS_E) ? relativeE : relativeXYZ;
+        if (a == AXIS_E && flowrateMultiplier != 1.0f) {
+            // Scale the extruded length, not the E coordinate
+            if (!relative) value -= axisPosition(AXIS_E);
+            value *= flowrateMultiplier;
+            relative = true;
         }
-        out += c;
-        i++;
+        target[a] = axisTarget(a, value, relative);
     }
-    out.trim();
-    return out;
-}
 
-static void handleMoveCommand(const String &gcode, bool allowExtrude) {
-    int fIndex = gcode.indexOf('F');
-    if (fIndex != -1) {
-        int fend = gcode.indexOf(' ', fIndex);
-        String fStr = (fend != -1) ? gcode.substring(fIndex + 1, fend) : gcode.substring(fIndex + 1);
-        int parsed = fStr.toInt();
-        if (parsed > 0) currentFeedrate = parsed;
+    // LCD preview: the target in absolute mode, the distance in relative mode
+    float preview[AXIS_COUNT];
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        bool relative = (a == AXIS_E) ? relativeE : relativeXYZ;
+        long base = relative ? plannerPosition(a) : 0;
+        preview[a] = (target[a] - base) / axisStepsPerMM(a);
     }
+    printer.nextX = preview[AXIS_X];
+    printer.nextY = preview[AXIS_Y];
+    printer.nextZ = preview[AXIS_Z];
+    printer.nextE = preview[AXIS_E];
+    printer.hasNextMove = true;
 
-    auto parseAxis = [&](char a, float &out)->bool {
-        int idx = gcode.indexOf(a);
-        if (idx == -1) return false;
-        int end = gcode.indexOf(' ', idx);
-        String valStr = (end != -1) ? gcode.substring(idx + 1, end) : gcode.substring(idx + 1);
-        out = valStr.toFloat();
-        return true;
-    };
-
-    float tx = 0, ty = 0, tz = 0, te = 0;
-    bool hx = parseAxis('X', tx);
-    bool hy = parseAxis('Y', ty);
-    bool hz = parseAxis('Z', tz);
-    bool he = allowExtrude ? parseAxis('E', te) : false;
-
-    if (useAbsoluteXYZ) {
-        if (!hx) tx = printer.posX;
-        if (!hy) ty = printer.posY;
-        if (!hz) tz = printer.posZ;
+    // hasNextMove stays set while the planner still holds queued moves
+    if (!moveToSteps(target, currentFeedrate * feedrateMultiplier)) return;
+
+    Serial.print(F("echo:Move"));
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        if (!given[a]) continue;
+        Serial.print(' ');
+        Serial.print(axisLetters[a]);
+        Serial.print(axisPosition(a));
     }
+    Serial.println();
+}
 
-    if (allowExtrude) {
-        if (useRelativeE) {
-            if (!he) te = 0;
-        } else {
-            if (!he) te = printer.posE;
-        }
+// G90 - 進入絕對座標模式
+static void gcodeG90(const GcodeCommand &) {
+    useAbsoluteXYZ = true;
+    useRelativeE = false;
+    sendReply(F("G90 Absolute mode"));
+}
+
+// G91 - 進入相對座標模式
+static void gcodeG91(const GcodeCommand &) {
+    useAbsoluteXYZ = false;
+    useRelativeE = true;
+    sendReply(F("G91 Relative mode"));
+}
+
+// M82 - Extruder absolute mode
+static void gcodeM82(const GcodeCommand &) {
+    useRelativeE = false;
+    sendReply(F("M82 E absolute"));
+}
+
+// M83 - Extruder relative mode
+static void gcodeM83(const GcodeCommand &) {
+    useRelativeE = true;
+    sendReply(F("M83 E relative"));
+}
+
+// G92 - 手動設定目前座標（包含 E 也會同步進度 eStart）
+static void gcodeG92(const GcodeCommand &gcode) {
+    float pos[AXIS_COUNT];
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        pos[a] = gcode.has(axisLetters[a]) ? gcode.value(axisLetters[a]) : axisPosition(a);
+    }
+    bool hasE = gcode.has('E');
+    if (hasE) {
+        printer.eStart = pos[AXIS_E];  // 同步進度起點，避免重設座標後估算錯誤
+    }
+    setCurrentPosition(pos);
+    if (hasE) {
+        sendReply(F("G92 E origin reset"));
     } else {
-        te = useRelativeE ? 0 : printer.posE;
+        sendReply(F("G92 Origin set"));
     }
+}
 
-    float distX = useAbsoluteXYZ ? tx - printer.posX : tx;
-    float distY = useAbsoluteXYZ ? ty - printer.posY : ty;
-    float distZ = useAbsoluteXYZ ? tz - printer.posZ : tz;
-    float distE = 0;
-    if (allowExtrude) {
-        distE = useRelativeE ? te : (useAbsoluteXYZ ? te - printer.posE : te);
-        distE *= flowrateMultiplier;
+// M104 Snnn - 設定加熱目標溫度（不等待）
+static void gcodeM104(const GcodeCommand &gcode) {
+    if (gcode.has('S')) {
+        float target = gcode.value('S');
+        printer.setTemp = target;
+        printer.heatDoneBeeped = false;
+        Serial.print(F("echo:Set temperature to "));
+        Serial.println(printer.setTemp);
     }
+}
 
-    float targetE = useRelativeE ? distE : (useAbsoluteXYZ ? printer.posE + distE : distE);
-
-    printer.remStepX = lroundf(fabsf(distX * stepsPerMM_X));
-    printer.remStepY = lroundf(fabsf(distY * stepsPerMM_Y));
-    printer.remStepZ = lroundf(fabsf(distZ * stepsPerMM_Z));
-    printer.remStepE = lroundf(fabsf(distE * stepsPerMM_E));
-    printer.signX = (distX >= 0) ? 1 : -1;
-    printer.signY = (distY >= 0) ? 1 : -1;
-    printer.signZ = (distZ >= 0) ? 1 : -1;
-    printer.signE = (distE >= 0) ? 1 : -1;
-
-    printer.nextX = useAbsoluteXYZ ? tx : distX;
-    printer.nextY = useAbsoluteXYZ ? ty : distY;
-    printer.nextZ = useAbsoluteXYZ ? tz : distZ;
-    if (allowExtrude) {
-        printer.nextE = useRelativeE ? distE : (useAbsoluteXYZ ? targetE : distE);
-    } else {
-        printer.nextE = useRelativeE ? 0 : printer.posE;
+// M109 Snnn - 設定溫度並等待
+static void gcodeM109(const GcodeCommand &gcode) {
+    if (gcode.has('S')) {
+        float target = gcode.value('S');
+        printer.setTemp = target;
+        printer.heatDoneBeeped = false;
+        printer.waitingForHeat = true;
+        Serial.print(F("echo:Heating to "));
+        Serial.println(printer.setTemp);
     }
-    printer.hasNextMove = true;
+}
 
-    moveAxes(tx, ty, tz, targetE, lroundf(currentFeedrate * feedrateMultiplier));
+static bool pollM109() {
+    if (!printer.waitingForHeat) return true;
+    if (printer.setTemp <= 0.0f) {
+        // Heater switched off by M104 S0, a timeout or a fault
+        printer.waitingForHeat = false;
+        return true;
+    }
+    if (fabs(printer.currentTemp - printer.setTemp) < 1.0 && printer.heatDoneBeeped) {
+        printer.waitingForHeat = false;
+        sendReply(F("Target temp reached"));
+        return true;
+    }
+    return false;
+}
 
-    printer.hasNextMove = false;
-    printer.remStepX = printer.remStepY = printer.remStepZ = printer.remStepE = 0;
+// M105 - 回報目前溫度
+static void gcodeM105(const GcodeCommand &) {
+    Serial.print(F("T:"));
+    Serial.print(printer.currentTemp, 1);
+    Serial.print(F(" /"));
+    Serial.print(printer.setTemp, 1);
+    Serial.println(F(" B:0.0 /0.0"));
+}
 
-    Serial.print(F("ok Move"));
-    if (hx) { Serial.print(F(" X")); Serial.print(printer.posX); }
-    if (hy) { Serial.print(F(" Y")); Serial.print(printer.posY); }
-    if (hz) { Serial.print(F(" Z")); Serial.print(printer.posZ); }
-    if (allowExtrude && (he || distE != 0)) { Serial.print(F(" E")); Serial.print(printer.posE); }
-    Serial.println();
+// M114 - 回報目前座標
+static void gcodeM114(const GcodeCommand &) {
+    Serial.print(F("X:")); Serial.print(axisPosition(AXIS_X));
+    Serial.print(F(" Y:")); Serial.print(axisPosition(AXIS_Y));
+    Serial.print(F(" Z:")); Serial.print(axisPosition(AXIS_Z));
+    Serial.print(F(" E:")); Serial.println(axisPosition(AXIS_E));
 }
 
-void processGcode() {
-    String gcode;
-    if (printer.waitingForHeat) {
-        if (fabs(printer.currentTemp - printer.setTemp) < 1.0 && printer.heatDoneBeeped) {
-            printer.waitingForHeat = false;
-            sendOk(F("Target temp reached"));
-        }
-        gcode = getGcodeInput();
-        if (gcode.length()) {
-            gcode.trim();
-            gcode = cleanGcode(gcode);
-            if (gcode.startsWith("M105")) {
-                Serial.print(F("ok T:"));
-                Serial.print(printer.currentTemp, 1);
-                Serial.print(F(" /"));
-                Serial.print(printer.setTemp, 1);
-                Serial.println(F(" B:0.0 /0.0"));
-            } else if (gcode.startsWith("M104")) {
-                int sIndex = gcode.indexOf('S');
-                if (sIndex != -1) {
-                    float target = gcode.substring(sIndex + 1).toFloat();
-                    if (!isnan(target)) {
-                        printer.setTemp = target;
-                        printer.heatDoneBeeped = false;
-                        Serial.print(F("ok Set temperature to "));
-                        Serial.println(printer.setTemp);
-                    }
-                }
-            } else if (gcode.startsWith("M109")) {
-                int sIndex = gcode.indexOf('S');
-                if (sIndex != -1) {
-                    float target = gcode.substring(sIndex + 1).toFloat();
-                    if (!isnan(target)) {
-                        printer.setTemp = target;
-                        printer.heatDoneBeeped = false;
-                        printer.waitingForHeat = true;
-                        Serial.print(F("ok Heating to "));
-                        Serial.println(printer.setTemp);
-                    }
-                }
-            }
+// M0 - 移動完成後暫停等待按鈕
+static bool pollM0() {
+    if (!movesFinished()) return false;
+    enterPauseMode();
+    sendReply(F("Paused"));
+    return true;
+}
+
+// G4 Snn or Pnn - 移動完成後延遲
+static long dwellMs = 0;
+static unsigned long dwellStart = 0;
+static bool dwelling = false;
+
+static void gcodeG4(const GcodeCommand &gcode) {
+    dwellMs = 0;
+    if (gcode.has('S')) {
+        dwellMs = (long)(gcode.value('S') * 1000.0);
+    } else if (gcode.has('P')) {
+        dwellMs = gcode.longValue('P');
+    }
+    dwelling = false;
+}
+
+static bool pollG4() {
+    if (!dwelling) {
+        if (!movesFinished()) return false;
+        dwellStart = millis();
+        dwelling = true;
+    }
+    if (dwellMs > 0 && (long)(millis() - dwellStart) < dwellMs) return false;
+    Serial.print(F("echo:Dwell "));
+    Serial.print(dwellMs);
+    Serial.println(F(" ms"));
+    return true;
+}
+
+// M301 Pn In Dn - 設定 PID 控制參數
+static void gcodeM301(const GcodeCommand &gcode) {
+    if (gcode.has('P')) printer.Kp = gcode.value('P');
+    if (gcode.has('I')) printer.Ki = gcode.value('I');
+    if (gcode.has('D')) printer.Kd = gcode.value('D');
+
+    saveSettingsToEEPROM();
+    Serial.print(F("echo:Kp:")); Serial.print(printer.Kp);
+    Serial.print(F(" Ki:")); Serial.print(printer.Ki);
+    Serial.print(F(" Kd:")); Serial.println(printer.Kd);
+}
+
+static void printHeaterModel() {
+    Serial.print(F("Model P:")); Serial.print(heaterModel.heaterPower, 1);
+    Serial.print(F(" C:")); Serial.print(heaterModel.blockHeatCap, 2);
+    Serial.print(F(" R:")); Serial.print(heaterModel.sensorResponse, 3);
+    Serial.print(F(" A:")); Serial.print(heaterModel.ambientXfer, 4);
+    Serial.print(F(" H:")); Serial.print(heaterModel.filamentHeatCap, 4);
+    Serial.print(F(" S:")); Serial.println(heaterMode);
+}
+
+// M303 Snnn Cn U1 - 繼電器法自動調校 PID（U1 套用並存入 EEPROM）
+static void gcodeM303(const GcodeCommand &gcode) {
+    float target = gcode.value('S', 200.0f);
+    uint8_t cycles = (uint8_t)constrain((int)gcode.value('C', 5.0f), 3, 20);
+    if (!startAutotune(target, cycles, gcode.value('U') > 0)) {
+        sendReply(F("PID autotune: bad target"));
+        return;
+    }
+    Serial.print(F("echo:PID autotune start at "));
+    Serial.print(target);
+    Serial.print(F(" for "));
+    Serial.print(cycles);
+    Serial.println(F(" cycles"));
+}
+
+// M306 Pn Cn Rn An Hn Sn - 熱端模型參數與控溫方式（S1 模型、S0 PID）
+// M306 Tnnn - 由室溫全功率加熱到 nnn 度（預設 200）量測模型
+static void gcodeM306(const GcodeCommand &gcode) {
+    if (gcode.has('T')) {
+        float target = gcode.value('T') > 0 ? gcode.value('T') : 200.0f;
+        if (!startModelLearn(target)) {
+            sendReply(F("Model learning needs a hot end below 50C"));
+            return;
         }
+        sendReply(F("Model learning started"));
         return;
     }
-    gcode = getGcodeInput();
-    if (gcode.length()) {
-        gcode.trim();
-        gcode = cleanGcode(gcode);
-        strncpy(printer.currentCmd, gcode.c_str(), sizeof(printer.currentCmd) - 1);
-        printer.currentCmd[sizeof(printer.currentCmd) - 1] = '\0';
-
-        if (gcode.startsWith("G90")) {          // G90 - 進入絕對座標模式
-
-            useAbsoluteXYZ = true;
-            useRelativeE = false;
-            sendOk(F("G90 Absolute mode"));
-        } else if (gcode.startsWith("G91")) {   // G91 - 進入相對座標模式
-            useAbsoluteXYZ = false;
-            useRelativeE = true;
-            sendOk(F("G91 Relative mode"));
-        } else if (gcode.startsWith("M82")) {   // M82 - Extruder absolute mode
-            useRelativeE = false;
-            sendOk(F("M82 E absolute"));
-        } else if (gcode.startsWith("M83")) {   // M83 - Extruder relative mode
-            useRelativeE = true;
-            sendOk(F("M83 E relative"));
-        } else if (gcode.startsWith("G92")) {   // G92 - 手動設定目前座標（包含 E 也會同步進度 eStart）
-            if (gcode.indexOf('X') != -1) printer.posX = gcode.substring(gcode.indexOf('X') + 1).toFloat();
-            if (gcode.indexOf('Y') != -1) printer.posY = gcode.substring(gcode.indexOf('Y') + 1).toFloat();
-            if (gcode.indexOf('Z') != -1) printer.posZ = gcode.substring(gcode.indexOf('Z') + 1).toFloat();
-            if (gcode.indexOf('E') != -1) {
-                printer.posE = gcode.substring(gcode.indexOf('E') + 1).toFloat();
-                printer.eStart = printer.posE;  // 同步進度起點，避免重設座標後估算錯誤
-                sendOk(F("G92 E origin reset"));
-            } else {
-                sendOk(F("G92 Origin set"));
-            }
-        } else if (gcode.startsWith("M104")) {  // M104 Snnn - 設定加熱目標溫度（不等待）
-            int sIndex = gcode.indexOf('S');
-            if (sIndex != -1) {
-                float target = gcode.substring(sIndex + 1).toFloat();
-                if (!isnan(target)) {
-                    printer.setTemp = target;
-                    printer.heatDoneBeeped = false;
-                    Serial.print(F("ok Set temperature to "));
-                    Serial.println(printer.setTemp);
-                }
-            }
-        } else if (gcode.startsWith("M109")) {  // M109 Snnn - 設定溫度並等待
-            int sIndex = gcode.indexOf('S');
-            if (sIndex != -1) {
-                float target = gcode.substring(sIndex + 1).toFloat();
-                if (!isnan(target)) {
-                    printer.setTemp = target;
-                    printer.heatDoneBeeped = false;
-                    printer.waitingForHeat = true;
-                    Serial.print(F("ok Heating to "));
-                    Serial.println(printer.setTemp);
-                }
-            }
-        } else if (gcode.startsWith("M105")) {  // M105 - 回報目前溫度
-            Serial.print(F("ok T:"));
-            Serial.print(printer.currentTemp, 1);
-            Serial.print(F(" /"));
-            Serial.print(printer.setTemp, 1);
-            Serial.println(F(" B:0.0 /0.0"));
-        } else if (gcode.startsWith("M114")) {  // M114 - 回報目前座標
-            Serial.print(F("ok X:")); Serial.print(printer.posX);
-            Serial.print(F(" Y:")); Serial.print(printer.posY);
-            Serial.print(F(" Z:")); Serial.print(printer.posZ);
-            Serial.print(F(" E:")); Serial.println(printer.posE);
-        } else if (gcode.startsWith("M0")) {    // M0 - 暫停等待按鈕
-            enterPauseMode();
-            sendOk(F("Paused"));
-        } else if (gcode.startsWith("G4")) {    // G4 Snn or Pnn - 延遲
-            long ms = 0;
-            int sIndex = gcode.indexOf('S');
-            int pIndex = gcode.indexOf('P');
-            if (sIndex != -1) {
-                ms = (long)(gcode.substring(sIndex + 1).toFloat() * 1000.0);
-            } else if (pIndex != -1) {
-                ms = gcode.substring(pIndex + 1).toInt();
-            }
-            if (ms > 0) delay(ms);
-            Serial.print(F("ok Dwell "));
-            Serial.print(ms);
-            Serial.println(F(" ms"));
-        } else if (gcode.startsWith("M301")) {  // M301 Pn In Dn - 設定 PID 控制參數
-            int pIndex = gcode.indexOf('P');
-            int iIndex = gcode.indexOf('I');
-            int dIndex = gcode.indexOf('D');
-
-            float temp;
-            if (pIndex != -1) {
-                temp = gcode.substring(pIndex + 1, (iIndex != -1 ? iIndex : gcode.length())).toFloat();
-                if (!isnan(temp)) printer.Kp = temp;
-            }
-            if (iIndex != -1) {
-                temp = gcode.substring(iIndex + 1, (dIndex != -1 ? dIndex : gcode.length())).toFloat();
-                if (!isnan(temp)) printer.Ki = temp;
-            }
-            if (dIndex != -1) {
-                temp = gcode.substring(dIndex + 1).toFloat();
-                if (!isnan(temp)) printer.Kd = temp;
-            }
-
-            saveSettingsToEEPROM();
-            Serial.print(F("ok Kp:")); Serial.print(printer.Kp);
-            Serial.print(F(" Ki:")); Serial.print(printer.Ki);
-            Serial.print(F(" Kd:")); Serial.println(printer.Kd);
-        } else if (gcode.startsWith("M400")) {  // M400 - 播放選定音樂，列印完成提示
+    if (gcode.value('P') > 0) heaterModel.heaterPower = gcode.value('P');
+    if (gcode.value('C') > 0) heaterModel.blockHeatCap = gcode.value('C');
+    if (gcode.value('R') > 0) heaterModel.sensorResponse = gcode.value('R');
+    if (gcode.value('A') > 0) heaterModel.ambientXfer = gcode.value('A');
+    if (gcode.has('H')) heaterModel.filamentHeatCap = max(gcode.value('H'), 0.0f);
+    if (gcode.has('S')) heaterMode = gcode.value('S') > 0 ? HEATER_MODEL : HEATER_PID;
+    printHeaterModel();
+}
+
+// M400 - 移動完成後播放選定音樂，列印完成提示
+static bool pollM400() {
+    if (!movesFinished()) return false;
 #ifndef NO_TUNES
-            playTune(DEFAULT_TUNE);
+    playTune(DEFAULT_TUNE);
 #else
-            simpleBeep(buzzerPin, 1000, 200);
+    simpleBeep(buzzerPin, 1000, 200);
+#endif
+    sendReply(F("Print Complete"));
+    return true;
+}
+
+// M92 - 設定各軸 steps/mm（移動完成後套用）
+static float pendingSteps[AXIS_COUNT];  // 0 keeps the axis unchanged
+
+static void gcodeM92(const GcodeCommand &gcode) {
+    pendingSteps[AXIS_X] = gcode.has('X') ? gcode.value('X') : 0;
+    pendingSteps[AXIS_Y] = gcode.has('Y') ? gcode.value('Y') : 0;
+    pendingSteps[AXIS_Z] = gcode.has('Z') ? gcode.value('Z') : 0;
+    pendingSteps[AXIS_E] = gcode.has('E') ? gcode.value('E') : 0;
+}
+
+static bool pollM92() {
+    // Keep the position in mm; its step count changes with the scale
+    if (!movesFinished()) return false;
+    float pos[AXIS_COUNT];
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) pos[a] = axisPosition(a);
+    if (pendingSteps[AXIS_X] > 0) stepsPerMM_X = pendingSteps[AXIS_X];
+    if (pendingSteps[AXIS_Y] > 0) stepsPerMM_Y = pendingSteps[AXIS_Y];
+    if (pendingSteps[AXIS_Z] > 0) stepsPerMM_Z = pendingSteps[AXIS_Z];
+    if (pendingSteps[AXIS_E] > 0) stepsPerMM_E = pendingSteps[AXIS_E];
+    setCurrentPosition(pos);
+    sendReply(F("Steps per mm updated"));
+    return true;
+}
+
+// M201 - 設定各軸最大加速度 (mm/s^2)
+static void gcodeM201(const GcodeCommand &gcode) {
+    if (gcode.value('X') > 0) maxAcceleration[AXIS_X] = gcode.value('X');
+    if (gcode.value('Y') > 0) maxAcceleration[AXIS_Y] = gcode.value('Y');
+    if (gcode.value('Z') > 0) maxAcceleration[AXIS_Z] = gcode.value('Z');
+    if (gcode.value('E') > 0) maxAcceleration[AXIS_E] = gcode.value('E');
+    sendReply(F("Max acceleration updated"));
+}
+
+// M204 - 設定列印(P)/空跑(T)加速度，S 同時設定兩者
+static void gcodeM204(const GcodeCommand &gcode) {
+    if (gcode.value('S') > 0) printAcceleration = travelAcceleration = gcode.value('S');
+    if (gcode.value('P') > 0) printAcceleration = gcode.value('P');
+    if (gcode.value('T') > 0) travelAcceleration = gcode.value('T');
+    Serial.print(F("echo:Accel P:")); Serial.print(printAcceleration);
+    Serial.print(F(" T:")); Serial.println(travelAcceleration);
+}
+
+// M205 - 設定各軸 jerk (mm/s^3)、轉角偏差 J 與加速曲線 P
+static void gcodeM205(const GcodeCommand &gcode) {
+    if (gcode.value('X') > 0) maxJerk[AXIS_X] = gcode.value('X');
+    if (gcode.value('Y') > 0) maxJerk[AXIS_Y] = gcode.value('Y');
+    if (gcode.value('Z') > 0) maxJerk[AXIS_Z] = gcode.value('Z');
+    if (gcode.value('E') > 0) maxJerk[AXIS_E] = gcode.value('E');
+    if (gcode.value('J') > 0) junctionDeviation = gcode.value('J');
+    if (gcode.has('P')) {
+        motionProfile = (gcode.value('P') >= 1.0f) ? PROFILE_SCURVE : PROFILE_TRAPEZOID;
+    }
+    Serial.print(F("echo:Profile:"));
+    Serial.println(motionProfile == PROFILE_SCURVE ? F("S-curve") : F("Trapezoid"));
+}
+
+// M290 En - 設定進度總量
+static void gcodeM290(const GcodeCommand &gcode) {
+    if (gcode.has('E')) {
+        long val = gcode.longValue('E');
+        if (val > 0) {
+            printer.eTotal = val;
+            printer.eStart = axisPosition(AXIS_E);
+            printer.eStartSynced = true;
+            printer.progress = 0;
+            Serial.print(F("echo:eTotal set to "));
+            Serial.println(printer.eTotal);
+        }
+    }
+}
+
+// M220 Snnn - 調整移動速度倍率
+static void gcodeM220(const GcodeCommand &gcode) {
+    if (gcode.has('S')) {
+        float val = gcode.value('S');
+        feedrateMultiplier = val / 100.0f;
+        Serial.print(F("echo:Feedrate scale "));
+        Serial.print(val);
+        Serial.println(F("%"));
+    }
+}
+
+// M221 Snnn - 調整擠出倍率
+static void gcodeM221(const GcodeCommand &gcode) {
+    if (gcode.has('S')) {
+        float val = gcode.value('S');
+        flowrateMultiplier = val / 100.0f;
+        Serial.print(F("echo:Flow scale "));
+        Serial.print(val);
+        Serial.println(F("%"));
+    }
+}
+
+// M500 - 儲存設定到 EEPROM
+static void gcodeM500(const GcodeCommand &) {
+    saveSettingsToEEPROM();
+    sendReply(F("Settings saved"));
+}
+
+// M503 - 印出目前參數
+static void gcodeM503(const GcodeCommand &) {
+    sendReply(F("Current settings"));
+    Serial.print(F("Kp = ")); Serial.println(printer.Kp);
+    Serial.print(F("Ki = ")); Serial.println(printer.Ki);
+    Serial.print(F("Kd = ")); Serial.println(printer.Kd);
+    printHeaterModel();
+    Serial.print(F("Steps/mm X:")); Serial.println(stepsPerMM_X);
+    Serial.print(F("Steps/mm Y:")); Serial.println(stepsPerMM_Y);
+    Serial.print(F("Steps/mm Z:")); Serial.println(stepsPerMM_Z);
+    Serial.print(F("Steps/mm E:")); Serial.println(stepsPerMM_E);
+    Serial.print(F("Max accel X:")); Serial.print(maxAcceleration[AXIS_X]);
+    Serial.print(F(" Y:")); Serial.print(maxAcceleration[AXIS_Y]);
+    Serial.print(F(" Z:")); Serial.print(maxAcceleration[AXIS_Z]);
+    Serial.print(F(" E:")); Serial.println(maxAcceleration[AXIS_E]);
+    Serial.print(F("Accel P:")); Serial.print(printAcceleration);
+    Serial.print(F(" T:")); Serial.println(travelAcceleration);
+    Serial.print(F("Max jerk X:")); Serial.print(maxJerk[AXIS_X]);
+    Serial.print(F(" Y:")); Serial.print(maxJerk[AXIS_Y]);
+    Serial.print(F(" Z:")); Serial.print(maxJerk[AXIS_Z]);
+    Serial.print(F(" E:")); Serial.println(maxJerk[AXIS_E]);
+    Serial.print(F("Junction dev:")); Serial.println(junctionDeviation, 3);
+    Serial.print(F("Profile:")); Serial.println(motionProfile);
+}
+
+// M881 - 回報各工作執行次數、平均／最長耗時與逾時次數（自上次 M881 起）
+static void gcodeM881(const GcodeCommand &) {
+    schedulerReport();
+#if defined(__AVR__)
+    Serial.print(F("stepper isr max:"));
+    Serial.print(stepperTakeMaxIsrTicks() / 2);
+    Serial.println(F("us"));
 #endif
-            sendOk(F("Print Complete"));
-        } else if (gcode.startsWith("M92")) {   // M92 - 設定各軸 steps/mm
-            int idx;
-            float val;
-
-            idx = gcode.indexOf('X');
-            if (idx != -1) {
-                int end = gcode.indexOf(' ', idx);
-                val = gcode.substring(idx + 1, end != -1 ? end : gcode.length()).toFloat();
-                if (!isnan(val)) stepsPerMM_X = val;
-            }
-            idx = gcode.indexOf('Y');
-            if (idx != -1) {
-                int end = gcode.indexOf(' ', idx);
-                val = gcode.substring(idx + 1, end != -1 ? end : gcode.length()).toFloat();
-                if (!isnan(val)) stepsPerMM_Y = val;
-            }
-            idx = gcode.indexOf('Z');
-            if (idx != -1) {
-                int end = gcode.indexOf(' ', idx);
-                val = gcode.substring(idx + 1, end != -1 ? end : gcode.length()).toFloat();
-                if (!isnan(val)) stepsPerMM_Z = val;
-            }
-            idx = gcode.indexOf('E');
-            if (idx != -1) {
-                int end = gcode.indexOf(' ', idx);
-                val = gcode.substring(idx + 1, end != -1 ? end : gcode.length()).toFloat();
-                if (!isnan(val)) stepsPerMM_E = val;
-            }
-            sendOk(F("Steps per mm updated"));
-        } else if (gcode.startsWith("M290")) { // M290 En - 設定進度總量
-            int eIndex = gcode.indexOf('E');
-            if (eIndex != -1) {
-                long val = gcode.substring(eIndex + 1).toInt();
-                if (val > 0) {
-                    printer.eTotal = val;
-                    printer.eStart = printer.posE;
-                    printer.eStartSynced = true;
-                    printer.progress = 0;
-                    Serial.print(F("ok eTotal set to "));
-                    Serial.println(printer.eTotal);
-                }
-            }
-        } else if (gcode.startsWith("M220")) { // M220 Snnn - 調整移動速度倍率
-            int sIndex = gcode.indexOf('S');
-            if (sIndex != -1) {
-                float val = gcode.substring(sIndex + 1).toFloat();
-                if (!isnan(val)) {
-                    feedrateMultiplier = val / 100.0f;
-                    Serial.print(F("ok Feedrate scale "));
-                    Serial.print(val);
-                    Serial.println(F("%"));
-                }
-            }
-        } else if (gcode.startsWith("M221")) { // M221 Snnn - 調整擠出倍率
-            int sIndex = gcode.indexOf('S');
-            if (sIndex != -1) {
-                float val = gcode.substring(sIndex + 1).toFloat();
-                if (!isnan(val)) {
-                    flowrateMultiplier = val / 100.0f;
-                    Serial.print(F("ok Flow scale "));
-                    Serial.print(val);
-                    Serial.println(F("%"));
-                }
-            }
-        } else if (gcode.startsWith("M500")) {  // M500 - 儲存設定到 EEPROM
-            saveSettingsToEEPROM();
-            sendOk(F("Settings saved"));
-        } else if (gcode.startsWith("M503")) {  // M503 - 印出目前參數
-            sendOk(F("Current settings"));
-            Serial.print(F("Kp = ")); Serial.println(printer.Kp);
-            Serial.print(F("Ki = ")); Serial.println(printer.Ki);
-            Serial.print(F("Kd = ")); Serial.println(printer.Kd);
-            Serial.print(F("Steps/mm X:")); Serial.println(stepsPerMM_X);
-            Serial.print(F("Steps/mm Y:")); Serial.println(stepsPerMM_Y);
-            Serial.print(F("Steps/mm Z:")); Serial.println(stepsPerMM_Z);
-            Serial.print(F("Steps/mm E:")); Serial.println(stepsPerMM_E);
-        } else if (gcode.startsWith("M84")) {  // M84 - 馬達釋放
-            digitalWrite(motorEnablePin, HIGH);
-            sendOk(F("Motors disabled"));
-        } else if (gcode.startsWith("G0")) {    // G0 - 快速移動，不擠料
-            handleMoveCommand(gcode, false);
-        } else if (gcode.startsWith("G1")) {    // G1 - 執行軸移動
-            handleMoveCommand(gcode, true);
-        } else if (gcode.startsWith("G28")) {   // G28 - 執行回原點並可指定軸
-            bool hx = gcode.indexOf('X') != -1;
-            bool hy = gcode.indexOf('Y') != -1;
-            bool hz = gcode.indexOf('Z') != -1;
-            if (!hx && !hy && !hz) {
-                hx = hy = hz = true; // 預設全部軸
-            }
-            if (hx) {
-                homeAxis(stepPinX, dirPinX, endstopX, "X");
-                printer.posX = 0.0f;
-            }
-            if (hy) {
-                homeAxis(stepPinY, dirPinY, endstopY, "Y");
-                printer.posY = 0.0f;
-            }
-            if (hz) {
-                homeAxis(stepPinZ, dirPinZ, endstopZ, "Z");
-                printer.posZ = 0.0f;
-            }
-            sendOk(F("G28 Done"));
-        } else {  // 其他未知指令
-            Serial.print(F("ok Unknown cmd: "));
-            Serial.println(gcode);
+}
+
+// M84 - 移動完成後釋放馬達
+static bool pollM84() {
+    if (!movesFinished()) return false;
+    digitalWrite(motorEnablePin, HIGH);
+    sendReply(F("Motors disabled"));
+    return true;
+}
+
+// G0 - 快速移動，不擠料
+static void gcodeG0(const GcodeCommand &gcode) {
+    handleMoveCommand(gcode, false);
+}
+
+// G1 - 執行軸移動
+static void gcodeG1(const GcodeCommand &gcode) {
+    handleMoveCommand(gcode, true);
+}
+
+// G28 - 執行回原點並可指定軸
+static void gcodeG28(const GcodeCommand &gcode) {
+    bool hx = gcode.has('X');
+    bool hy = gcode.has('Y');
+    bool hz = gcode.has('Z');
+    if (!hx && !hy && !hz) {
+        hx = hy = hz = true; // 預設全部軸
+    }
+    homingStart(hx, hy, hz);
+}
+
+static bool pollG28() {
+    HomingResult result = homingPoll();
+    if (result == HOMING_RUNNING) return false;
+    if (result == HOMING_DONE) sendReply(F("G28 Done"));
+    return true;
+}
+
+// M120 - 移動時監看限位開關，觸發即停止並回報位置
+static void gcodeM120(const GcodeCommand &) {
+    setEndstopMonitoring(true);
+    sendReply(F("Endstops on"));
+}
+
+// M121 - 停止監看限位開關（歸零不受影響）
+static void gcodeM121(const GcodeCommand &) {
+    setEndstopMonitoring(false);
+    sendReply(F("Endstops off"));
+}
+
+// M880 S1 - 切換為二進位移動協定（見 binary_link.h），主機需等到回覆後再送封包
+static void gcodeM880(const GcodeCommand &gcode) {
+    if (gcode.value('S') >= 1.0f) {
+        binaryLinkBegin();
+        sendReply(F("Binary mode on"));
+    } else {
+        sendReply(F("Binary mode off"));
+    }
+}
+
+// Command may run while another command is still in progress or the
+// heater is being tuned
+#define CMD_ALLOW_WHILE_BUSY 0x01
+// Report that may also run ahead of lines queued behind a busy command
+#define CMD_RUN_AHEAD 0x02
+
+typedef void (*GcodeHandler)(const GcodeCommand &gcode);
+// Called every pass while the command is in progress; true when finished
+typedef bool (*CommandPoll)();
+
+// A long-running command is split in two: the handler (if any) takes the
+// parameters and returns at once, then its poll function keeps the command
+// going from processGcode() until it reports done. Serial, the queue and
+// status reports are serviced meanwhile; only CMD_ALLOW_WHILE_BUSY lines
+// run, the rest stay queued. CMD_RUN_AHEAD lines also run from behind a
+// held line, so a host polling M105 is answered during a long heat-up.
+struct GcodeEntry {
+    uint16_t key;           // commandKey() of the command word
+    uint8_t flags;          // CMD_* bits
+    GcodeHandler handler;
+    CommandPoll poll;       // nullptr for commands that finish in the handler
+};
+
+static CommandPoll activeCommand = nullptr;
+
+// Sort key for the dispatch table: letter in the top bits, number below
+static constexpr uint16_t commandKey(char letter, int code) {
+    return (uint16_t)(((letter == 'G' ? 0 : letter == 'M' ? 1 : 2) << 12) | (code & 0x0FFF));
+}
+
+// Sorted by key; kept in flash and searched by bisection
+static constexpr GcodeEntry commandTable[] PROGMEM = {
+    { commandKey('G', 0), 0, gcodeG0, nullptr },
+    { commandKey('G', 1), 0, gcodeG1, nullptr },
+    { commandKey('G', 4), 0, gcodeG4, pollG4 },
+    { commandKey('G', 28), 0, gcodeG28, pollG28 },
+    { commandKey('G', 90), 0, gcodeG90, nullptr },
+    { commandKey('G', 91), 0, gcodeG91, nullptr },
+    { commandKey('G', 92), 0, gcodeG92, nullptr },
+    { commandKey('M', 0), 0, nullptr, pollM0 },
+    { commandKey('M', 82), 0, gcodeM82, nullptr },
+    { commandKey('M', 83), 0, gcodeM83, nullptr },
+    { commandKey('M', 84), 0, nullptr, pollM84 },
+    { commandKey('M', 92), 0, gcodeM92, pollM92 },
+    { commandKey('M', 104), CMD_ALLOW_WHILE_BUSY, gcodeM104, nullptr },
+    { commandKey('M', 105), CMD_ALLOW_WHILE_BUSY | CMD_RUN_AHEAD, gcodeM105, nullptr },
+    { commandKey('M', 109), CMD_ALLOW_WHILE_BUSY, gcodeM109, pollM109 },
+    { commandKey('M', 114), 0, gcodeM114, nullptr },
+    { commandKey('M', 120), 0, gcodeM120, nullptr },
+    { commandKey('M', 121), 0, gcodeM121, nullptr },
+    { commandKey('M', 201), 0, gcodeM201, nullptr },
+    { commandKey('M', 204), 0, gcodeM204, nullptr },
+    { commandKey('M', 205), 0, gcodeM205, nullptr },
+    { commandKey('M', 220), 0, gcodeM220, nullptr },
+    { commandKey('M', 221), 0, gcodeM221, nullptr },
+    { commandKey('M', 290), 0, gcodeM290, nullptr },
+    { commandKey('M', 301), 0, gcodeM301, nullptr },
+    { commandKey('M', 303), 0, gcodeM303, nullptr },
+    { commandKey('M', 306), 0, gcodeM306, nullptr },
+    { commandKey('M', 400), 0, nullptr, pollM400 },
+    { commandKey('M', 500), 0, gcodeM500, nullptr },
+    { commandKey('M', 503), 0, gcodeM503, nullptr },
+    { commandKey('M', 880), 0, gcodeM880, nullptr },
+    { commandKey('M', 881), CMD_ALLOW_WHILE_BUSY | CMD_RUN_AHEAD, gcodeM881, nullptr },
+};
+static constexpr uint8_t COMMAND_COUNT = sizeof(commandTable) / sizeof(commandTable[0]);
+
+static constexpr bool commandTableSorted(const GcodeEntry* t, uint8_t n) {
+    return n < 2 || (t[0].key < t[1].key && commandTableSorted(t + 1, n - 1));
+}
+static_assert(commandTableSorted(commandTable, COMMAND_COUNT),
+              "commandTable must stay sorted by letter and number");
+
+static bool findCommand(const GcodeCommand &gcode, GcodeEntry &entry) {
+    if (!gcode.letter || gcode.code < 0 || gcode.code > 0x0FFF) return false;
+    uint16_t key = commandKey(gcode.letter, gcode.code);
+    uint8_t lo = 0, hi = COMMAND_COUNT;
+    while (lo < hi) {
+        uint8_t mid = (lo + hi) / 2;
+        memcpy_P(&entry, &commandTable[mid], sizeof(entry));
+        if (entry.key == key) return true;
+        if (entry.key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return false;
+}
+
+// Lines behind the queue head already found not to be CMD_RUN_AHEAD, so a
+// held queue is parsed once rather than on every pass
+static uint8_t queueChecked = 1;
+
+static void discardHead() {
+    commandQueueDiscard();
+    if (queueChecked > 1) queueChecked--;
+}
+
+// While the head line waits, run the reports queued behind it
+static void runQueuedReports() {
+    char* line;
+    while ((line = commandQueueAt(queueChecked))) {
+        GcodeEntry entry;
+        if ((uint8_t)line[0] != BINARY_MOVE_MARKER && parseGcodeLine(line, cmd) &&
+            findCommand(cmd, entry) && (entry.flags & CMD_RUN_AHEAD)) {
+            entry.handler(cmd);
+            commandQueueRemove(queueChecked);
+        } else {
+            queueChecked++;
         }
     }
 }
 
+bool gcodeIdle() {
+    return !activeCommand && !commandQueuePeek();
+}
+
+void processGcode() {
+    if (activeCommand && activeCommand()) activeCommand = nullptr;
+
+    char* line = getGcodeInput();
+    if (!line) return;
+
+    bool busy = activeCommand || heaterTuning();
 
+    // Binary move frames skip the text parser entirely
+    if ((uint8_t)line[0] == BINARY_MOVE_MARKER) {
+        if (busy) {
+            runQueuedReports();
+            return;
+        }
+        runBinaryMove((const uint8_t*)line + 1);
+        discardHead();
+        return;
+    }
+    if (!parseGcodeLine(line, cmd)) {
+        discardHead();  // nothing left to run after cleaning
+        return;
+    }
+
+    GcodeEntry entry;
+    bool known = findCommand(cmd, entry);
+    // While busy only flagged commands run; the rest stay queued. A flagged
+    // long-running command (M109) may only restart itself.
+    if (busy && !(known && (entry.flags & CMD_ALLOW_WHILE_BUSY) &&
+                  (!entry.poll || entry.poll == activeCommand))) {
+        runQueuedReports();
+        return;
+    }
+
+    strncpy(printer.currentCmd, line, sizeof(printer.currentCmd) - 1);
+    printer.currentCmd[sizeof(printer.currentCmd) - 1] = '\0';
+    if (known) {
+        if (entry.handler) entry.handler(cmd);
+        if (entry.poll) activeCommand = entry.poll;
+    } else {  // 其他未知指令
+        Serial.print(F("echo:Unknown cmd: "));
+        Serial.println(line);
+    }
+    discardHead();
+}
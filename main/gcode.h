@@ -5,9 +5,10 @@
 #include <Arduino.h>
 
 void processGcode();
-void sendOk(const __FlashStringHelper* msg = nullptr);
-void sendOk(const char* msg);
-void sendOk();
+// True when no command is queued or still in progress (G4, M109, G28 ...)
+bool gcodeIdle();
+void sendReply(const __FlashStringHelper* msg);
+void sendReply(const char* msg);
 void enterPauseMode();
 #include "motion.h"
 
@@ -0,0 +1,6 @@
+#pragma once
+// C++11 has no std::index_sequence; build the 0..N-1 pack by hand. Used to
+// fill PROGMEM tables from constexpr functions at compile time.
+template <int... I> struct IndexSeq {};
+template <int N, int... I> struct MakeIndexSeq : MakeIndexSeq<N - 1, N - 1, I...> {};
+template <int... I> struct MakeIndexSeq<0, I...> { typedef IndexSeq<I...> type; };
@@ -1,11 +1,37 @@
 #include "interrupts.h"
 #include <EnableInterrupt.h>
 #include "pins.h"
+#include "stepper.h"
 
 volatile bool buttonTriggered = false;
+static bool endstopsWatched = false;
 
 void onButtonInterrupt() { buttonTriggered = true; }
 
+// Switches pull the input low, so a falling edge is a hit. All three are
+// watched; the stepper only acts on one whose axis runs toward it.
+static void onEndstopX() { stepperEndstopTriggered(AXIS_X); }
+static void onEndstopY() { stepperEndstopTriggered(AXIS_Y); }
+static void onEndstopZ() { stepperEndstopTriggered(AXIS_Z); }
+
+void setEndstopMonitoring(bool enabled) {
+    if (enabled == endstopsWatched) return;
+    endstopsWatched = enabled;
+    if (enabled) {
+        enableInterrupt(endstopX, onEndstopX, FALLING);
+        enableInterrupt(endstopY, onEndstopY, FALLING);
+        enableInterrupt(endstopZ, onEndstopZ, FALLING);
+    } else {
+        disableInterrupt(endstopX);
+        disableInterrupt(endstopY);
+        disableInterrupt(endstopZ);
+    }
+}
+
+bool endstopMonitoring() {
+    return endstopsWatched;
+}
+
 void setupInterrupts() {
     pinMode(buttonPin, INPUT_PULLUP);
     pinMode(endstopX, INPUT_PULLUP);
@@ -5,3 +5,8 @@ extern volatile bool buttonTriggered;
 
 void setupInterrupts();
 void onButtonInterrupt();
+
+// M120/M121: watch the endstops during normal moves; a switch that
+// triggers stops the move (see stepperEndstopTriggered())
+void setEndstopMonitoring(bool enabled);
+bool endstopMonitoring();
@@ -0,0 +1,61 @@
+#include "lcd_frame.h"
+#include <Wire.h>
+#include <LiquidCrystal_I2C.h>
+#include <string.h>
+
+static const uint8_t LCD_CELLS = LCD_COLS * LCD_ROWS;
+static const uint8_t CURSOR_UNKNOWN = 0xFF;
+
+static LiquidCrystal_I2C lcd(0x27, LCD_COLS, LCD_ROWS);
+static char frame[LCD_CELLS];       // what the screens want shown
+static char shown[LCD_CELLS];       // what the panel shows
+static uint8_t scanPos = 0;         // next cell lcdFlush() looks at
+static uint8_t lcdCursor = CURSOR_UNKNOWN;
+
+void lcdBegin() {
+    lcd.init();
+    lcd.backlight();
+    lcd.clear();
+    memset(frame, ' ', sizeof(frame));
+    memset(shown, ' ', sizeof(shown));
+    lcdCursor = 0;
+}
+
+void lcdPutChar(uint8_t col, uint8_t row, char c) {
+    if (col < LCD_COLS && row < LCD_ROWS) frame[row * LCD_COLS + col] = c;
+}
+
+void lcdPrint(uint8_t col, uint8_t row, const char* text) {
+    while (*text && col < LCD_COLS) lcdPutChar(col++, row, *text++);
+}
+
+void lcdPrintLine(uint8_t row, const char* text) {
+    uint8_t col = 0;
+    while (text[col] && col < LCD_COLS) {
+        lcdPutChar(col, row, text[col]);
+        col++;
+    }
+    while (col < LCD_COLS) lcdPutChar(col++, row, ' ');
+}
+
+bool lcdFlush(uint8_t maxBytes) {
+    uint8_t budget = maxBytes;
+    for (uint8_t n = 0; n < LCD_CELLS; n++) {
+        uint8_t i = scanPos;
+        if (frame[i] != shown[i]) {
+            bool move = lcdCursor != i;
+            if (budget < (move ? 2 : 1)) return false;
+            if (move) {
+                lcd.setCursor(i % LCD_COLS, i / LCD_COLS);
+                budget--;
+            }
+            lcd.write((uint8_t)frame[i]);
+            budget--;
+            shown[i] = frame[i];
+            // The panel's address counter does not wrap onto the next row
+            lcdCursor = (i % LCD_COLS == LCD_COLS - 1) ? CURSOR_UNKNOWN : i + 1;
+        }
+        scanPos = (scanPos + 1) % LCD_CELLS;
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <Arduino.h>
+
+// The 16x2 LCD is drawn through a frame buffer: screens only write the
+// frame in RAM, and lcdFlush() sends the characters that differ from what
+// the panel shows, a few bytes per call. A full redraw is spread over
+// several ticks instead of holding the I2C bus for one long burst.
+#define LCD_COLS 16
+#define LCD_ROWS 2
+// LCD bytes (characters plus cursor moves) sent per lcdFlush() call
+#define LCD_FLUSH_BYTES 4
+
+void lcdBegin();
+
+// Write text into the frame at (col, row), clipped at the end of the row
+void lcdPrint(uint8_t col, uint8_t row, const char* text);
+void lcdPutChar(uint8_t col, uint8_t row, char c);
+// Replace a whole row, padding with spaces
+void lcdPrintLine(uint8_t row, const char* text);
+
+// Send up to maxBytes of pending changes; adjacent changed characters
+// share one cursor move. Returns true when the panel matches the frame.
+bool lcdFlush(uint8_t maxBytes = LCD_FLUSH_BYTES);
@@ -1,8 +1,6 @@
 // Simulation flags are defined in config.h
 #include "config.h"
 
-#include <Wire.h>
-#include <LiquidCrystal_I2C.h>
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
@@ -10,13 +8,16 @@
 #include <EEPROM.h>
 #include "pins.h"
 #include "temp_control.h"
+#include "scheduler.h"
+#include "lcd_frame.h"
 #include "gcode.h"
 #include "tunes.h"
 #include "state.h"
 #include "motion.h"
 #include "interrupts.h"
-
-LiquidCrystal_I2C lcd(0x27, 16, 2);
+#include "stepper.h"
+#include "planner.h"
+#include "serial_rx.h"
 
 int currentFeedrate = 1200;  // 預設速度 mm/min
 unsigned long heatStableStart = 0;
@@ -41,12 +42,7 @@ const unsigned long idleSwitchDelay = 0;
 bool isLongPress = false;
 bool displayFrozen = false;
 unsigned long freezeStartTime = 0;
-const unsigned long freezeDuration = 3000;
-
-unsigned long lastLoopTime = 0;
-const unsigned long loopInterval = 100;
-
-char lastDisplayContent[33] = {0};
+unsigned long freezeDuration = 3000;
 
 // 進度估算變數由 state 模組管理
 
@@ -59,6 +55,14 @@ void saveSettingsToEEPROM() {
     EEPROM.put(20, stepsPerMM_Y);
     EEPROM.put(24, stepsPerMM_Z);
     EEPROM.put(28, stepsPerMM_E);
+    EEPROM.put(32, maxAcceleration);
+    EEPROM.put(48, printAcceleration);
+    EEPROM.put(52, travelAcceleration);
+    EEPROM.put(56, maxJerk);
+    EEPROM.put(72, junctionDeviation);
+    EEPROM.put(76, motionProfile);
+    EEPROM.put(80, heaterModel);
+    EEPROM.put(100, heaterMode);
 }
 
 void loadSettingsFromEEPROM() {
@@ -70,6 +74,14 @@ void loadSettingsFromEEPROM() {
     EEPROM.get(20, stepsPerMM_Y);
     EEPROM.get(24, stepsPerMM_Z);
     EEPROM.get(28, stepsPerMM_E);
+    EEPROM.get(32, maxAcceleration);
+    EEPROM.get(48, printAcceleration);
+    EEPROM.get(52, travelAcceleration);
+    EEPROM.get(56, maxJerk);
+    EEPROM.get(72, junctionDeviation);
+    EEPROM.get(76, motionProfile);
+    EEPROM.get(80, heaterModel);
+    EEPROM.get(100, heaterMode);
 
     // Validate values in case EEPROM has never been written
     if (!isfinite(printer.Kp) || !isfinite(printer.Ki) || !isfinite(printer.Kd)) {
@@ -84,6 +96,24 @@ void loadSettingsFromEEPROM() {
     if (!isfinite(printer.setTemp) || printer.setTemp < 0 || printer.setTemp > 300) {
         printer.setTemp = 0.0f;
     }
+    bool limitsValid = isfinite(printAcceleration) && printAcceleration > 0 &&
+                       isfinite(travelAcceleration) && travelAcceleration > 0 &&
+                       isfinite(junctionDeviation) && junctionDeviation > 0 &&
+                       motionProfile <= PROFILE_SCURVE;
+    for (int i = 0; i < AXIS_COUNT; i++) {
+        if (!isfinite(maxAcceleration[i]) || maxAcceleration[i] <= 0 ||
+            !isfinite(maxJerk[i]) || maxJerk[i] <= 0) {
+            limitsValid = false;
+        }
+    }
+    if (!limitsValid) resetMotionLimits();
+    bool modelValid = heaterMode <= HEATER_MODEL &&
+                      isfinite(heaterModel.heaterPower) && heaterModel.heaterPower > 0 &&
+                      isfinite(heaterModel.blockHeatCap) && heaterModel.blockHeatCap > 0 &&
+                      isfinite(heaterModel.sensorResponse) && heaterModel.sensorResponse > 0 &&
+                      isfinite(heaterModel.ambientXfer) && heaterModel.ambientXfer > 0 &&
+                      isfinite(heaterModel.filamentHeatCap) && heaterModel.filamentHeatCap >= 0;
+    if (!modelValid) resetHeaterModel();
 }
 
 
@@ -91,22 +121,8 @@ void loadSettingsFromEEPROM() {
 
 
 void showMessage(const char* line1, const char* line2) {
-    char newContent[33];
-    for (int i = 0; i < 16; i++) {
-        newContent[i] = (i < strlen(line1)) ? line1[i] : ' ';
-        newContent[i + 16] = (i < strlen(line2)) ? line2[i] : ' ';
-    }
-    newContent[32] = '\0';
-
-    if (memcmp(newContent, lastDisplayContent, 32) == 0) return;
-
-    for (int i = 0; i < 32; i++) {
-        if (newContent[i] != lastDisplayContent[i]) {
-            lcd.setCursor(i % 16, i / 16);
-            lcd.print(newContent[i]);
-            lastDisplayContent[i] = newContent[i];
-        }
-    }
+    lcdPrintLine(0, line1);
+    lcdPrintLine(1, line2);
 }
 
 void displayProgressScreen() {
@@ -187,18 +203,18 @@ void displayCoordScreen() {
     if (useAbsoluteXYZ) {
         idx = 0;
         line1[idx++] = 'X';
-        idx += formatFloat1(line1 + idx, printer.posX);
+        idx += formatFloat1(line1 + idx, axisPosition(AXIS_X));
         line1[idx++] = ' ';
         line1[idx++] = 'Y';
-        idx += formatFloat1(line1 + idx, printer.posY);
+        idx += formatFloat1(line1 + idx, axisPosition(AXIS_Y));
         line1[idx] = '\0';
 
         idx = 0;
         line2[idx++] = 'Z';
-        idx += formatFloat1(line2 + idx, printer.posZ);
+        idx += formatFloat1(line2 + idx, axisPosition(AXIS_Z));
         line2[idx++] = ' ';
         line2[idx++] = 'E';
-        idx += formatFloat1(line2 + idx, printer.posE);
+        idx += formatFloat1(line2 + idx, axisPosition(AXIS_E));
         line2[idx] = '\0';
     } else {
         idx = 0;
@@ -297,7 +313,6 @@ void updateLCD() {
             return;
         }
         displayFrozen = false;
-        memset(lastDisplayContent, 0, sizeof(lastDisplayContent));
     }
     if (printer.paused) {
         showMessage("** Paused **", "Press Button");
@@ -320,15 +335,12 @@ void updateLCD() {
     }
 
     bool moving = (millis() - printer.lastMoveTime) < 1000 && printer.movingAxis != ' ';
-    lcd.setCursor(11, 1);
-    lcd.print(printer.heaterOn ? 'H' : ' ');
-    lcd.setCursor(12, 1);
-    lcd.print(useAbsoluteXYZ ? "ABS" : "REL");
-    lcd.setCursor(15, 1);
+    lcdPutChar(11, 1, printer.heaterOn ? 'H' : ' ');
+    lcdPrint(12, 1, useAbsoluteXYZ ? "ABS" : "REL");
     if (moving) {
-        lcd.print(printer.movingDir > 0 ? '>' : '<');
+        lcdPutChar(15, 1, printer.movingDir > 0 ? '>' : '<');
     } else {
-        lcd.print(anim[animPos]);
+        lcdPutChar(15, 1, anim[animPos]);
         animPos = (animPos + 1) % 4;
     }
 }
@@ -344,9 +356,12 @@ void checkButton() {
     if (printer.paused) {
         if (justPressed()) {
             printer.paused = false;
+            // Shown for a moment while the display task keeps flushing in
+            // its normal slices; nothing waits for the panel
             showMessage("Resuming", "");
-            delay(300);
-            memset(lastDisplayContent, 0, sizeof(lastDisplayContent));
+            displayFrozen = true;
+            freezeStartTime = now;
+            freezeDuration = 300;
         }
         prevState = state;
         return;
@@ -357,7 +372,6 @@ void checkButton() {
             printer.eTotal = -1;
             printer.progress = 0;
             printer.eStartSynced = false;
-            memset(lastDisplayContent, 0, sizeof(lastDisplayContent)); // force LCD refresh
         }
         prevState = state;
         return;
@@ -371,7 +385,7 @@ void checkButton() {
     if (state && !isLongPress && now - pressStartTime > 50) {
         if (longPressed(3000)) {
             enterPauseMode();
-            sendOk(F("Paused"));
+            sendReply(F("Paused"));
             isLongPress = true;
         }
     }
@@ -401,13 +415,12 @@ void autoSwitchDisplay() {
 void enterPauseMode() {
     printer.paused = true;
     showMessage("** Paused **", "Press Button");
-    memset(lastDisplayContent, 0, sizeof(lastDisplayContent));
 }
 
 
 void runTemperatureTask() {
     readTemperature();
-    controlHeater();
+    serviceHeater();
 }
 
 void runInputTask() {
@@ -419,6 +432,10 @@ void runDisplayTask() {
     updateLCD();
 }
 
+void runLcdTask() {
+    lcdFlush();
+}
+
 void runGcodeTask() {
     if (!printer.paused) {
         processGcode();
@@ -447,27 +464,36 @@ void setup() {
     pinMode(dirPinE, OUTPUT);
 
     digitalWrite(motorEnablePin, HIGH);
-    lcd.init();
-    lcd.backlight();
-    lcd.setCursor(0, 0);
-    lcd.print("System Ready");
+    initHeaterPWM();
+    initTemperatureSensor();
+    initStepper();
+    lcdBegin();
+    lcdPrint(0, 0, "System Ready");
+    lcdFlush(255);
     delay(1000);
-    lcd.clear();
+    showMessage("", "");
     lastDisplaySwitch = millis();
 
     Serial.begin(115200);
     resetPrinterState();
     loadSettingsFromEEPROM();
+    initPlanner();
+
+    // Serial and G-code run every pass; the heater itself is on a timer,
+    // so its task only publishes readings and handles alerts
+    schedulerAdd(F("serial"), serialPoll, 0, 0);
+    schedulerAdd(F("endstops"), serviceEndstops, 0, 0);
+    schedulerAdd(F("gcode"), runGcodeTask, 0, 1);
+    schedulerAdd(F("temperature"), runTemperatureTask, 100, 2);
+    schedulerAdd(F("input"), runInputTask, 50, 3);
+#ifndef NO_TUNES
+    schedulerAdd(F("tune"), tuneService, 10, 3);
+#endif
+    schedulerAdd(F("display"), runDisplayTask, 100, 4);
+    schedulerAdd(F("lcd"), runLcdTask, 10, 5);
 }
 
 void loop() {
-    unsigned long now = millis();
-    if (now - lastLoopTime >= loopInterval) {
-        lastLoopTime = now;
-        runTemperatureTask();
-        runInputTask();
-        runDisplayTask();
-        runGcodeTask();
-    }
+    stepperService();
+    schedulerRun();
 }
-
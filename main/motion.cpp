@@ -4,253 +4,236 @@
 #include "gcode.h"
 #include <Arduino.h>
 #include "config.h"
+#include "stepper.h"
+#include "planner.h"
+#include "scheduler.h"
+
+// Rounding remainder of relative moves per axis, in steps, so repeated
+// small moves do not drift from the commanded distance
+static float stepRemainder[AXIS_COUNT] = {0.0f, 0.0f, 0.0f, 0.0f};
+static const char axisNames[] = "XYZE";
+
+// Keep serial, the UI and the heater serviced while waiting on the planner;
+// the G-code task that is waiting here is skipped by the scheduler
+static void motionIdle() {
+    stepperService();
+    schedulerRun();
+}
 
-// Access button handling from main program
-extern void checkButton();
-extern bool useRelativeE;
-extern int displayMode;
-extern void updateLCD();
-
+bool movesFinished() {
+    if (!stepperIdle()) return false;
+    printer.hasNextMove = false;
+    return true;
+}
 
-// Calculate step count and apply extrusion limits
-static long calculateSteps(char axis, float currentPos, float &distance, float spm) {
-    if (axis == 'E' && distance > 0) {
-        extern int eMaxSteps;
-        if (currentPos + distance > eMaxSteps) {
-            distance = eMaxSteps - currentPos;
-            if (distance <= 0) return 0;
-        }
+enum HomingPhase {
+    HOMING_IDLE,        // pick the next group of axes
+    HOMING_APPROACH,    // fast move toward the endstops
+    HOMING_BACKOFF,     // move HOMING_BUMP mm away again
+    HOMING_PROBE        // slow move back onto the endstops
+};
+
+static uint8_t homingAxes = 0;      // bit per axis still to home
+static uint8_t homingGroup = 0;     // axes homed together in this pass
+static uint8_t homingPhase = HOMING_IDLE;
+
+// Queue a homing move of `mm` on the group's axes, negative toward the
+// endstops; `probe` stops each axis at its endstop
+static void queueHomingMove(float mm, float feedrate, bool probe) {
+    long target[AXIS_COUNT];
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        target[a] = plannerPosition(a);
+        if (homingGroup & _BV(a)) target[a] += lroundf(mm * axisStepsPerMM(a));
     }
-    return lroundf(fabsf(distance * spm));
+    stepperTakeEndstopHits();
+    plannerBufferSteps(target, feedrate, probe ? homingGroup : 0);
 }
 
-// Set motor direction based on travel distance
-static void setMotorDirection(int dirPin, float distance) {
-    int dir = (distance >= 0.0f) ? HIGH : LOW;
-    digitalWrite(dirPin, dir);
+static void zeroHomingGroup() {
+    float pos[AXIS_COUNT];
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        pos[a] = (homingGroup & _BV(a)) ? 0.0f : axisPosition(a);
+    }
+    setCurrentPosition(pos);
 }
 
-// Simple acceleration control
-static void moveWithAccel(int stepPin, long steps, long minDelay) {
-    const int ACCEL_STEPS = 50;
-    long startDelay = minDelay * 2;  // start slower then ramp up
-    int rampSteps = min(steps / 2, (long)ACCEL_STEPS);
-    long delayDelta = rampSteps > 0 ? (startDelay - minDelay) / rampSteps : 0;
-    long currentDelay = startDelay;
-
-    unsigned long lastPoll = millis();
-    for (long i = 0; i < steps; i++) {
-        digitalWrite(stepPin, HIGH);
-        // Maintain high pulse for reliable 1/4 step operation
-        delayMicroseconds(1000);
-        digitalWrite(stepPin, LOW);
+static float homingFeedrate() {
+    return (homingGroup & _BV(AXIS_Z)) ? HOMING_FEEDRATE_Z : HOMING_FEEDRATE_XY;
+}
 
-        unsigned long now = millis();
-        if (now - lastPoll >= 50) {
-            lastPoll = now;
-            checkButton();
-            if (displayMode == 1) updateLCD();
-        }
+static HomingResult homingFailed(uint8_t axes, const __FlashStringHelper* reason) {
+    Serial.print(F("ERROR: Homing failed "));
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        if (axes & _BV(a)) Serial.print(axisNames[a]);
+    }
+    Serial.println(reason);
+    homingAxes = 0;
+    homingPhase = HOMING_IDLE;
+    return HOMING_FAILED;
+}
 
-        delayMicroseconds(currentDelay);
+void homingStart(bool x, bool y, bool z) {
+    homingAxes = (x ? _BV(AXIS_X) : 0) | (y ? _BV(AXIS_Y) : 0) | (z ? _BV(AXIS_Z) : 0);
+    homingPhase = HOMING_IDLE;
+}
 
-        if (rampSteps > 0) {
-            if (i < rampSteps) {
-                // acceleration zone
-                currentDelay = max(minDelay, currentDelay - delayDelta);
-            } else if (i >= steps - rampSteps) {
-                // deceleration zone
-                currentDelay = min(startDelay, currentDelay + delayDelta);
-            }
+HomingResult homingPoll() {
+    if (!movesFinished()) return HOMING_RUNNING;
+    uint8_t missed;
+
+    switch (homingPhase) {
+    case HOMING_IDLE:
+        if (!homingAxes) return HOMING_DONE;
+        // X and Y share one move, Z goes on its own afterwards
+        homingGroup = homingAxes & (_BV(AXIS_X) | _BV(AXIS_Y));
+        if (!homingGroup) homingGroup = _BV(AXIS_Z);
+        queueHomingMove(-HOMING_MAX_TRAVEL, homingFeedrate(), true);
+        homingPhase = HOMING_APPROACH;
+        return HOMING_RUNNING;
+
+    case HOMING_APPROACH:
+        missed = homingGroup & ~stepperTakeEndstopHits();
+        if (missed) return homingFailed(missed, F(": endstop not reached"));
+        zeroHomingGroup();
+        queueHomingMove(HOMING_BUMP, homingFeedrate(), false);
+        homingPhase = HOMING_BACKOFF;
+        return HOMING_RUNNING;
+
+    case HOMING_BACKOFF:
+        missed = readEndstops(homingGroup);
+        if (missed) return homingFailed(missed, F(": endstop stuck"));
+        queueHomingMove(-2.0f * HOMING_BUMP, homingFeedrate() / HOMING_SLOW_DIVISOR, true);
+        homingPhase = HOMING_PROBE;
+        return HOMING_RUNNING;
+
+    default:
+        missed = homingGroup & ~stepperTakeEndstopHits();
+        if (missed) return homingFailed(missed, F(": endstop not reached"));
+        zeroHomingGroup();
+        for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+            if (!(homingGroup & _BV(a))) continue;
+            Serial.print(F("echo:")); Serial.print(axisNames[a]); Serial.println(F(" Homed"));
         }
+        homingAxes &= ~homingGroup;
+        homingPhase = HOMING_IDLE;
+        return homingAxes ? HOMING_RUNNING : HOMING_DONE;
     }
 }
 
-void moveAxis(int stepPin, int dirPin, float& pos, float target, int feedrate, char axis) {
-    float distance;
-    if (axis == 'E' && useRelativeE) {
-        distance = target;
-    } else {
-        distance = useAbsoluteXYZ ? target - pos : target;
-    }
-
-    float spm = stepsPerMM_X;
-    if (axis == 'Y') spm = stepsPerMM_Y;
-    else if (axis == 'Z') spm = stepsPerMM_Z;
-    else if (axis == 'E') spm = stepsPerMM_E;
-
-    long steps = calculateSteps(axis, pos, distance, spm);
-#ifdef SIMULATE_EXTRUDER
-    if (axis == 'E') {
-        pos += distance; // update without physical movement
+// Set while a crash stop holds the stepper, until the pause it started ends
+static bool endstopHold = false;
+// Counts crash stops, so a move waiting for planner room sees one happen
+static uint8_t crashStops = 0;
+
+void serviceEndstops() {
+    if (endstopHold) {
+        // Moves sent after the hit are planned from where the carriage
+        // stopped; they only run once the user resumes
+        if (printer.paused) return;
+        endstopHold = false;
+        stepperResume();
         return;
     }
-#endif
-    if (steps == 0) {
-        pos += distance; // update by actual movement (likely zero)
-        return;
+    long unfinished[AXIS_COUNT];
+    uint8_t axes = stepperHaltedBy(unfinished);
+    if (!axes) return;
+    plannerClearQueue(unfinished);
+    endstopHold = true;
+    crashStops++;
+    printer.hasNextMove = false;
+
+    Serial.print(F("echo:Endstop hit "));
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        if (axes & _BV(a)) Serial.print(axisNames[a]);
     }
-
-    digitalWrite(motorEnablePin, LOW);
-    setMotorDirection(dirPin, distance);
-
-    long stepPeriod = (long)(60000000.0 / (feedrate * spm));
-    // account for 1 ms high pulse so resulting period matches commanded F
-    long minDelay = max(50L, stepPeriod - 1000L);
-
-    moveWithAccel(stepPin, steps, minDelay);
-
-    digitalWrite(motorEnablePin, HIGH);
-
-    // Update position once using final travel distance
-    pos += distance;
+    for (uint8_t a = 0; a < AXIS_E; a++) {
+        Serial.print(' ');
+        Serial.print(axisNames[a]);
+        Serial.print(':');
+        Serial.print(axisPosition(a));
+        Serial.print(F(" ("));
+        Serial.print(plannerPosition(a));
+        Serial.print(')');
+    }
+    Serial.println();
+    enterPauseMode();
 }
 
-void homeAxis(int stepPin, int dirPin, int endstopPin, const char* label) {
-    digitalWrite(motorEnablePin, LOW);
-    digitalWrite(dirPin, LOW);
-    while (digitalRead(endstopPin) == HIGH) {
-        digitalWrite(stepPin, HIGH);
-        delayMicroseconds(1000);
-        digitalWrite(stepPin, LOW);
-        delayMicroseconds(1000);
+long axisTarget(uint8_t axis, float value, bool relative) {
+    float spm = axisStepsPerMM(axis);
+    if (!relative) {
+        stepRemainder[axis] = 0.0f;
+        return lroundf(value * spm);
     }
-    digitalWrite(motorEnablePin, HIGH);
-    Serial.print(F("ok ")); Serial.print(label); Serial.println(F(" Homed"));
+    float exact = value * spm + stepRemainder[axis];
+    long delta = lroundf(exact);
+    stepRemainder[axis] = exact - delta;
+    return plannerPosition(axis) + delta;
 }
 
-// Accelerated multi-axis movement using Bresenham/DDA
-static void moveWithAccelSync(long stepsX, long stepsY, long stepsZ, long stepsE,
-                              long maxSteps, long minDelay) {
-    const int ACCEL_STEPS = 50;
-    long startDelay = minDelay * 2;
-    int rampSteps = min(maxSteps / 2, (long)ACCEL_STEPS);
-    long delayDelta = rampSteps > 0 ? (startDelay - minDelay) / rampSteps : 0;
-    long currentDelay = startDelay;
-
-    long errX = maxSteps / 2;
-    long errY = maxSteps / 2;
-    long errZ = maxSteps / 2;
-    long errE = maxSteps / 2;
-
-    unsigned long lastPoll = millis();
-    for (long i = 0; i < maxSteps; i++) {
-        bool doX = false, doY = false, doZ = false, doE = false;
-        if (stepsX) { errX -= stepsX; if (errX < 0) { errX += maxSteps; doX = true; } }
-        if (stepsY) { errY -= stepsY; if (errY < 0) { errY += maxSteps; doY = true; } }
-        if (stepsZ) { errZ -= stepsZ; if (errZ < 0) { errZ += maxSteps; doZ = true; } }
-        if (stepsE) { errE -= stepsE; if (errE < 0) { errE += maxSteps; doE = true; } }
-
-        if (doX) digitalWrite(stepPinX, HIGH);
-        if (doY) digitalWrite(stepPinY, HIGH);
-        if (doZ) digitalWrite(stepPinZ, HIGH);
-#ifndef SIMULATE_EXTRUDER
-        if (doE) digitalWrite(stepPinE, HIGH);
-#endif
-        if (doX || doY || doZ || doE) delayMicroseconds(1000);
-        if (doX) { digitalWrite(stepPinX, LOW); if (printer.remStepX > 0) printer.remStepX--; }
-        if (doY) { digitalWrite(stepPinY, LOW); if (printer.remStepY > 0) printer.remStepY--; }
-        if (doZ) { digitalWrite(stepPinZ, LOW); if (printer.remStepZ > 0) printer.remStepZ--; }
-#ifndef SIMULATE_EXTRUDER
-        if (doE) { digitalWrite(stepPinE, LOW); if (printer.remStepE > 0) printer.remStepE--; }
-#else
-        if (doE && printer.remStepE > 0) printer.remStepE--;
-#endif
-
-        unsigned long now = millis();
-        if (now - lastPoll >= 50) {
-            lastPoll = now;
-            checkButton();
-            if (displayMode == 1) updateLCD();
-        }
-
-        delayMicroseconds(currentDelay);
-
-        if (rampSteps > 0) {
-            if (i < rampSteps) {
-                currentDelay = max(minDelay, currentDelay - delayDelta);
-            } else if (i >= maxSteps - rampSteps) {
-                currentDelay = min(startDelay, currentDelay + delayDelta);
-            }
-        }
-    }
+float axisPosition(uint8_t axis) {
+    return plannerPosition(axis) / axisStepsPerMM(axis);
 }
 
-void moveAxes(float targetX, float targetY, float targetZ, float targetE, int feedrate) {
-    float distX = useAbsoluteXYZ ? targetX - printer.posX : targetX;
-    float distY = useAbsoluteXYZ ? targetY - printer.posY : targetY;
-    float distZ = useAbsoluteXYZ ? targetZ - printer.posZ : targetZ;
-    float distE;
-    if (useRelativeE) {
-        distE = targetE;
-    } else {
-        distE = useAbsoluteXYZ ? targetE - printer.posE : targetE;
-    }
+void setCurrentPosition(const float pos[AXIS_COUNT]) {
+    plannerSetPosition(pos[AXIS_X], pos[AXIS_Y], pos[AXIS_Z], pos[AXIS_E]);
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) stepRemainder[a] = 0.0f;
+}
 
-    float spmX = stepsPerMM_X;
-    float spmY = stepsPerMM_Y;
-    float spmZ = stepsPerMM_Z;
-    float spmE = stepsPerMM_E;
+bool moveToSteps(const long target[AXIS_COUNT], float feedrate) {
+    long t[AXIS_COUNT];
+    long delta[AXIS_COUNT];
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) t[a] = target[a];
 
-    long stepsX = calculateSteps('X', printer.posX, distX, spmX);
-    long stepsY = calculateSteps('Y', printer.posY, distY, spmY);
-    long stepsZ = calculateSteps('Z', printer.posZ, distZ, spmZ);
-    long stepsE = calculateSteps('E', printer.posE, distE, spmE);
+    // Extrusion limit; eMaxSteps has always been applied to the E position in mm
+    long eLimit = lroundf(eMaxSteps * stepsPerMM_E);
+    if (t[AXIS_E] > eLimit && t[AXIS_E] > plannerPosition(AXIS_E)) {
+        t[AXIS_E] = max(eLimit, plannerPosition(AXIS_E));
+    }
 
-    long maxSteps = max(max(stepsX, stepsY), max(stepsZ, stepsE));
-    if (maxSteps == 0) {
-        printer.posX += distX;
-        printer.posY += distY;
-        printer.posZ += distZ;
-        printer.posE += distE;
-        return;
+    bool moving = false;
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        delta[a] = t[a] - plannerPosition(a);
+        if (delta[a]) moving = true;
     }
+    if (!moving) return true;
 
-    if (distE != 0) {
+    if (delta[AXIS_E]) {
         if (printer.eTotal == -1) {
             Serial.println(F("WARN: eTotal unset"));
         }
         if (!printer.eStartSynced) {
-            printer.eStart = printer.posE;
+            printer.eStart = axisPosition(AXIS_E);
             printer.eStartSynced = true;
         }
     }
 
-    digitalWrite(motorEnablePin, LOW);
-    setMotorDirection(dirPinX, distX);
-    setMotorDirection(dirPinY, distY);
-    setMotorDirection(dirPinZ, distZ);
-#ifndef SIMULATE_EXTRUDER
-    setMotorDirection(dirPinE, distE);
-#endif
-
-    float spmLongest = spmX;
-    if (stepsY >= stepsX && stepsY >= stepsZ && stepsY >= stepsE) spmLongest = spmY;
-    else if (stepsZ >= stepsX && stepsZ >= stepsY && stepsZ >= stepsE) spmLongest = spmZ;
-    else if (stepsE >= stepsX && stepsE >= stepsY && stepsE >= stepsZ) spmLongest = spmE;
-
-    long stepPeriod = (long)(60000000.0 / (feedrate * spmLongest));
-    long minDelay = max(50L, stepPeriod - 1000L);
-
-    moveWithAccelSync(stepsX, stepsY, stepsZ, stepsE, maxSteps, minDelay);
-
-    digitalWrite(motorEnablePin, HIGH);
-
-    printer.posX += distX;
-    printer.posY += distY;
-    printer.posZ += distZ;
-    printer.posE += distE;
+    // A crash stop while waiting clears the queue this move was planned
+    // behind; its target no longer follows from the position, so the move
+    // is dropped with the rest
+    uint8_t stops = crashStops;
+    while (!plannerBufferSteps(t, feedrate)) {
+        motionIdle();
+        if (crashStops != stops) {
+            Serial.println(F("echo:Move dropped by endstop hit"));
+            return false;
+        }
+    }
 
     updateProgress();
 
-    char axis = 'X';
-    float disp = distX;
-    float absDist = fabsf(distX);
-    if (fabsf(distY) > absDist) { axis='Y'; absDist=fabsf(distY); disp = distY; }
-    if (fabsf(distZ) > absDist) { axis='Z'; absDist=fabsf(distZ); disp = distZ; }
-    if (fabsf(distE) > absDist) { axis='E'; absDist=fabsf(distE); disp = distE; }
-    printer.movingAxis = axis;
-    printer.movingDir = (disp >= 0) ? 1 : -1;
+    // Axis with the longest travel, shown on the LCD
+    uint8_t longest = AXIS_X;
+    float longestMM = 0.0f;
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        float mm = fabsf(delta[a] / axisStepsPerMM(a));
+        if (mm > longestMM) {
+            longestMM = mm;
+            longest = a;
+        }
+    }
+    printer.movingAxis = axisNames[longest];
+    printer.movingDir = (delta[longest] >= 0) ? 1 : -1;
     printer.lastMoveTime = millis();
+    return true;
 }
-
@@ -1,8 +1,37 @@
 #pragma once
 #include <Arduino.h>
+#include "stepper.h"
 
-void moveAxis(int stepPin, int dirPin, float& pos, float target, int feedrate, char axis);
+// Homing runs as a G28 command task: homingStart() picks the axes and
+// homingPoll(), called every pass, drives the homing moves through the
+// planner. X and Y home together, then Z; each group approaches fast,
+// backs off and re-probes slowly before it is zeroed. An axis that does
+// not reach its endstop within HOMING_MAX_TRAVEL fails the whole G28.
+enum HomingResult { HOMING_RUNNING, HOMING_DONE, HOMING_FAILED };
 
-void homeAxis(int stepPin, int dirPin, int endstopPin, const char* label);
+void homingStart(bool x, bool y, bool z);
+HomingResult homingPoll();
 
-void moveAxes(float targetX, float targetY, float targetZ, float targetE, int feedrate);
+// Collect a move stopped by an endstop (M120): drop the queued moves, set
+// the position to where the axes stopped, report it and pause the print.
+// The stepper stays halted until the pause ends, so nothing queued in the
+// meantime moves the machine.
+void serviceEndstops();
+
+// The machine position is kept in steps by the planner; these convert
+// G-code values once and derive mm only for reporting.
+
+// Step target for one axis from an absolute position or a relative
+// distance in mm; relative moves carry their rounding remainder
+long axisTarget(uint8_t axis, float value, bool relative);
+// Position in mm at the end of the queued moves (M114, LCD, progress)
+float axisPosition(uint8_t axis);
+// G92/G28/M92: define the current position in mm without moving
+void setCurrentPosition(const float pos[AXIS_COUNT]);
+
+// Queue a move to absolute machine steps; returns once the block is queued,
+// or false when a crash stop dropped the move while it waited for room
+bool moveToSteps(const long target[AXIS_COUNT], float feedrate);
+
+// True once every queued move has been stepped out
+bool movesFinished();
@@ -0,0 +1,82 @@
+#include "parser.h"
+
+static inline bool isDigitChar(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline char upperChar(char c) {
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+// Parse a decimal number starting at `p`, copying its characters to `out`.
+// Cheaper than strtod() and never touches the heap.
+static float parseNumber(const char*& p, char*& out) {
+    bool neg = false;
+    if (*p == '-' || *p == '+') {
+        neg = (*p == '-');
+        *out++ = *p++;
+    }
+    unsigned long whole = 0;
+    while (isDigitChar(*p)) {
+        if (whole < 100000000UL) whole = whole * 10 + (*p - '0');
+        *out++ = *p++;
+    }
+    float val = whole;
+    if (*p == '.') {
+        *out++ = *p++;
+        unsigned long frac = 0;
+        unsigned long scale = 1;
+        while (isDigitChar(*p)) {
+            if (scale < 100000000UL) {
+                frac = frac * 10 + (*p - '0');
+                scale *= 10;
+            }
+            *out++ = *p++;
+        }
+        val += (float)frac / scale;
+    }
+    return neg ? -val : val;
+}
+
+bool parseGcodeLine(char* line, GcodeCommand& cmd) {
+    cmd.letter = 0;
+    cmd.code = 0;
+    cmd.seen = 0;
+
+    const char* p = line;
+    char* out = line;  // compaction never overtakes the read pointer
+    while (*p) {
+        char c = *p;
+        if (c == ';' || c == '*' || c == '\n' || c == '\r') break;
+        if (c == ' ' || c == '\t') {
+            if (out != line && out[-1] != ' ') *out++ = ' ';
+            p++;
+            continue;
+        }
+        char letter = upperChar(c);
+        if (letter == 'N' && (isDigitChar(p[1]) || p[1] == '-')) {
+            // Line number: skip it together with the following space
+            p++;
+            while (isDigitChar(*p) || *p == '-') p++;
+            if (*p == ' ') p++;
+            continue;
+        }
+        if (letter < 'A' || letter > 'Z') {
+            *out++ = *p++;
+            continue;
+        }
+        *out++ = letter;
+        p++;
+        float val = parseNumber(p, out);
+        if (cmd.letter == 0 && (letter == 'G' || letter == 'M' || letter == 'T')) {
+            cmd.letter = letter;
+            cmd.code = (int)val;
+        } else {
+            cmd.seen |= 1UL << (letter - 'A');
+            cmd.values[letter - 'A'] = val;
+        }
+    }
+    while (out != line && out[-1] == ' ') out--;
+    *out = '\0';
+    return line[0] != '\0';
+}
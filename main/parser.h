@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+
+// Longest accepted G-code line including the terminator
+#define GCODE_LINE_MAX 96
+
+// One parsed G-code line. Parameter words are stored by letter so lookups
+// are a bit test and an array read; nothing is allocated.
+struct GcodeCommand {
+    char letter;        // 'G', 'M' or 'T'; 0 when the line has no command
+    int code;           // command number, e.g. 28 for G28
+    uint32_t seen;      // bit (c - 'A') set for each parameter word present
+    float values[26];   // parameter values indexed by letter
+
+    bool is(char l, int c) const { return letter == l && code == c; }
+    bool has(char c) const { return (seen & (1UL << (c - 'A'))) != 0; }
+    float value(char c, float fallback = 0.0f) const {
+        return has(c) ? values[c - 'A'] : fallback;
+    }
+    long longValue(char c, long fallback = 0) const {
+        return has(c) ? (long)values[c - 'A'] : fallback;
+    }
+};
+
+// Tokenise `line` in one pass. Line numbers (Nxxx), checksums (*xx) and
+// ';' comments are dropped and the buffer is compacted in place to the
+// cleaned, trimmed text. Returns false when nothing is left to execute.
+bool parseGcodeLine(char* line, GcodeCommand& cmd);
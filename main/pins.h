@@ -1,4 +1,21 @@
 #pragma once
+#include <Arduino.h>
+
+// 腳位編號 (compile-time values, used by FastPin<> in fastio.h)
+#define STEP_PIN_X       2
+#define DIR_PIN_X        5
+#define STEP_PIN_Y       3
+#define DIR_PIN_Y        6
+#define STEP_PIN_Z       4
+#define DIR_PIN_Z        7
+// Extruder uses D12 so motor enable can stay on D8
+#define STEP_PIN_E       12
+#define DIR_PIN_E        13
+#define MOTOR_ENABLE_PIN 8
+#define HEATER_PIN       10
+#define ENDSTOP_PIN_X    A0
+#define ENDSTOP_PIN_Y    A1
+#define ENDSTOP_PIN_Z    A2
 
 // 馬達控制腳位
 extern const int stepPinX, dirPinX;
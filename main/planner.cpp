@@ -0,0 +1,337 @@
+#include "planner.h"
+#include "gcode.h"
+#include <math.h>
+
+float maxAcceleration[AXIS_COUNT];
+float maxJerk[AXIS_COUNT];
+float printAcceleration;
+float travelAcceleration;
+float junctionDeviation;
+uint8_t motionProfile;
+
+static PlannerBlock blocks[PLANNER_BUFFER_SIZE];
+static volatile uint8_t blockHead = 0;  // next free slot (planner)
+static volatile uint8_t blockTail = 0;  // oldest block, executing first (stepper)
+
+// Machine position in steps after the last queued block
+static long position[AXIS_COUNT] = {0, 0, 0, 0};
+// Direction and speed of the last XYZ move for the junction calculation
+static float previousUnit[3] = {0.0f, 0.0f, 0.0f};
+static float previousNominalSpeed = 0.0f;
+
+static inline uint8_t nextBlockIndex(uint8_t i) {
+    return (i + 1) & (PLANNER_BUFFER_SIZE - 1);
+}
+
+static inline uint8_t prevBlockIndex(uint8_t i) {
+    return (i - 1) & (PLANNER_BUFFER_SIZE - 1);
+}
+
+float axisStepsPerMM(uint8_t axis) {
+    switch (axis) {
+        case AXIS_X: return stepsPerMM_X;
+        case AXIS_Y: return stepsPerMM_Y;
+        case AXIS_Z: return stepsPerMM_Z;
+        default:     return stepsPerMM_E;
+    }
+}
+
+// Highest speed from which `distance` mm at `accel` can still reach `target`
+static float maxAllowableSpeed(float accel, float target, float distance) {
+    return sqrtf(target * target + 2.0f * accel * distance);
+}
+
+// Smallest shift that brings `ticks` down to at most `limit`
+static uint8_t shiftFor(unsigned long ticks, unsigned long limit) {
+    uint8_t shift = 0;
+    while ((ticks >> shift) > limit) shift++;
+    return shift;
+}
+
+// Ramp from v0 to v1 steps/s at `accel` steps/s^2. With a jerk limit the
+// ramp keeps the trapezoid's duration and uses the smallest peak
+// acceleration that fits the change in at that jerk, falling back to a
+// triangular acceleration profile when it cannot.
+static void buildRamp(StepRamp& r, float v0, float v1, float accel, float jerk) {
+    float dv = fabsf(v1 - v0);
+    float T = dv / accel;
+    float tj = 0.0f, peak = accel, j = 0.0f;
+    if (jerk > 0.0f && T > 0.0f) {
+        float disc = jerk * jerk * T * T - 4.0f * jerk * dv;
+        if (disc >= 0.0f) {
+            peak = 0.5f * (jerk * T - sqrtf(disc));
+            tj = peak / jerk;
+            j = jerk;
+        } else {
+            tj = 0.5f * T;
+            peak = 2.0f * dv / T;
+            j = peak / tj;
+        }
+    }
+    r.duration = (unsigned long)(T * STEPPER_TIMER_HZ);
+    r.jerkTicks = (unsigned long)(tj * STEPPER_TIMER_HZ);
+    r.change = (uint16_t)(dv + 0.5f);
+    r.jerkChange = (uint16_t)(0.5f * j * tj * tj + 0.5f);
+    // The interrupt multiplies the Q16 coefficients by at most 16 bits of
+    // time (12 bits squared, less 8), so every product stays below
+    // change * 2^16
+    r.jerkShift = shiftFor(r.jerkTicks, 0xFFF);
+    r.slopeShift = shiftFor(r.duration, 0xFFFF);
+    float jerkUnit = (float)(1UL << r.jerkShift) / STEPPER_TIMER_HZ;
+    r.jerkCoef = (unsigned long)(0.5f * j * jerkUnit * jerkUnit * 256.0f * 65536.0f);
+    r.slopeCoef = (unsigned long)(peak * (1UL << r.slopeShift) / STEPPER_TIMER_HZ * 65536.0f);
+}
+
+// Convert entry/exit speeds into the step-rate trapezoid the interrupt runs.
+// Returns false if the stepper already owns the block.
+static bool calculateTrapezoid(PlannerBlock* b, float entry, float exit) {
+    float spm = b->stepEventCount / b->millimeters;
+    unsigned long nominal = b->nominalRate;
+    unsigned long minRate = min(MIN_STEP_RATE, nominal);
+    unsigned long initial = constrain((unsigned long)(entry * spm), minRate, nominal);
+    unsigned long final = constrain((unsigned long)(exit * spm), minRate, nominal);
+    float accel = b->acceleration * spm;  // steps/s^2
+
+    float nom2 = (float)nominal * nominal;
+    float init2 = (float)initial * initial;
+    float final2 = (float)final * final;
+    long accelSteps = (long)ceilf((nom2 - init2) / (2.0f * accel));
+    long decelSteps = (long)floorf((nom2 - final2) / (2.0f * accel));
+    long plateau = b->stepEventCount - accelSteps - decelSteps;
+    if (plateau < 0) {
+        // Cannot reach nominal speed: accelerate until the two ramps meet
+        accelSteps = (long)ceilf((2.0f * accel * b->stepEventCount - init2 + final2) / (4.0f * accel));
+        accelSteps = constrain(accelSteps, 0L, b->stepEventCount);
+        plateau = 0;
+    }
+
+    // The interrupt clips trapezoid ramps at the nominal and final rates, so
+    // they simply span the full range; S-curve ramps end where the linear
+    // ramp would and have to be shaped for that rate
+    StepRamp accelRamp, decelRamp;
+    if (b->profile == PROFILE_SCURVE) {
+        float peak = min((float)nominal, sqrtf(init2 + 2.0f * accel * accelSteps));
+        buildRamp(accelRamp, initial, peak, accel, b->jerkSteps);
+        buildRamp(decelRamp, peak, final, accel, b->jerkSteps);
+    } else {
+        buildRamp(accelRamp, initial, nominal, accel, 0.0f);
+        buildRamp(decelRamp, nominal, final, accel, 0.0f);
+    }
+
+    bool written = false;
+    noInterrupts();
+    if (!b->busy) {
+        b->initialRate = initial;
+        b->finalRate = final;
+        b->accelerateUntil = accelSteps;
+        b->decelerateAfter = accelSteps + plateau;
+        b->accelRamp = accelRamp;
+        b->decelRamp = decelRamp;
+        b->exitSpeed = exit;
+        written = true;
+    }
+    interrupts();
+    return written;
+}
+
+// Look-ahead over the queued blocks: a reverse pass limits each entry speed
+// by what the following blocks can decelerate from, a forward pass by what
+// the previous block can accelerate to, then trapezoids are rebuilt.
+static void recalculate() {
+    uint8_t head = blockHead;
+    // The oldest block's entry speed is fixed (it starts from rest or from the
+    // exit of a finished block); once it runs, so is the next block's.
+    uint8_t first = blockTail;
+    if (blocks[first].busy) first = nextBlockIndex(first);
+    if (first == head) return;
+
+    float nextEntry = 0.0f;
+    for (uint8_t i = prevBlockIndex(head); i != first; i = prevBlockIndex(i)) {
+        PlannerBlock* b = &blocks[i];
+        float entry = min(b->maxEntrySpeed, maxAllowableSpeed(b->acceleration, nextEntry, b->millimeters));
+        if (entry != b->entrySpeed) {
+            b->entrySpeed = entry;
+            b->recalculate = true;
+        }
+        nextEntry = entry;
+    }
+
+    PlannerBlock* prev = &blocks[first];
+    for (uint8_t i = nextBlockIndex(first); i != head; i = nextBlockIndex(i)) {
+        PlannerBlock* b = &blocks[i];
+        float limit = maxAllowableSpeed(prev->acceleration, prev->entrySpeed, prev->millimeters);
+        if (b->entrySpeed > limit) {
+            b->entrySpeed = limit;
+            b->recalculate = true;
+        }
+        prev = b;
+    }
+
+    for (uint8_t i = first; i != head; i = nextBlockIndex(i)) {
+        PlannerBlock* b = &blocks[i];
+        uint8_t n = nextBlockIndex(i);
+        float exit = (n != head) ? blocks[n].entrySpeed : 0.0f;
+        if (!b->recalculate && exit == b->exitSpeed) continue;
+        if (calculateTrapezoid(b, b->entrySpeed, exit)) {
+            b->recalculate = false;
+        } else if (n != head) {
+            // The stepper took the block meanwhile; match the next entry to
+            // the exit speed it will actually reach
+            blocks[n].entrySpeed = b->exitSpeed;
+            blocks[n].recalculate = true;
+        }
+    }
+}
+
+void resetMotionLimits() {
+    maxAcceleration[AXIS_X] = maxAcceleration[AXIS_Y] = DEFAULT_MAX_ACCEL_XY;
+    maxAcceleration[AXIS_Z] = DEFAULT_MAX_ACCEL_Z;
+    maxAcceleration[AXIS_E] = DEFAULT_MAX_ACCEL_E;
+    maxJerk[AXIS_X] = maxJerk[AXIS_Y] = DEFAULT_MAX_JERK_XY;
+    maxJerk[AXIS_Z] = DEFAULT_MAX_JERK_Z;
+    maxJerk[AXIS_E] = DEFAULT_MAX_JERK_E;
+    printAcceleration = DEFAULT_ACCELERATION;
+    travelAcceleration = DEFAULT_TRAVEL_ACCELERATION;
+    junctionDeviation = JUNCTION_DEVIATION;
+    motionProfile = PROFILE_TRAPEZOID;
+}
+
+void initPlanner() {
+    blockHead = blockTail = 0;
+    plannerSetPosition(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+bool plannerFull() {
+    return nextBlockIndex(blockHead) == blockTail;
+}
+
+bool plannerEmpty() {
+    return blockHead == blockTail;
+}
+
+uint8_t plannerFreeBlocks() {
+    return (blockTail - blockHead - 1) & (PLANNER_BUFFER_SIZE - 1);
+}
+
+void plannerSetPosition(float x, float y, float z, float e) {
+    position[AXIS_X] = lroundf(x * stepsPerMM_X);
+    position[AXIS_Y] = lroundf(y * stepsPerMM_Y);
+    position[AXIS_Z] = lroundf(z * stepsPerMM_Z);
+    position[AXIS_E] = lroundf(e * stepsPerMM_E);
+    previousNominalSpeed = 0.0f;
+}
+
+void plannerClearQueue(const long unfinished[AXIS_COUNT]) {
+    for (uint8_t i = blockTail; i != blockHead; i = nextBlockIndex(i)) {
+        const PlannerBlock* b = &blocks[i];
+        for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+            position[a] -= (b->dirBits & _BV(a)) ? -b->steps[a] : b->steps[a];
+        }
+    }
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) position[a] -= unfinished[a];
+    blockTail = blockHead;
+    previousNominalSpeed = 0.0f;
+}
+
+long plannerPosition(uint8_t axis) {
+    return position[axis];
+}
+
+bool plannerBufferSteps(const long targetSteps[AXIS_COUNT], float feedrate,
+                        uint8_t endstopBits) {
+    if (plannerFull()) return false;
+
+    float delta[AXIS_COUNT];
+    PlannerBlock* b = &blocks[blockHead];
+    b->busy = false;
+    b->dirBits = 0;
+    b->endstopBits = endstopBits;
+    b->stepEventCount = 0;
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        float spm = axisStepsPerMM(a);
+        long d = targetSteps[a] - position[a];
+        if (d < 0) b->dirBits |= _BV(a);
+        b->steps[a] = labs(d);
+        b->stepEventCount = max(b->stepEventCount, b->steps[a]);
+        delta[a] = d / spm;
+    }
+    if (b->stepEventCount == 0) return true;
+
+    float xyz2 = delta[AXIS_X] * delta[AXIS_X] + delta[AXIS_Y] * delta[AXIS_Y] +
+                 delta[AXIS_Z] * delta[AXIS_Z];
+    bool hasXYZ = xyz2 > 0.0f;
+    b->millimeters = hasXYZ ? sqrtf(xyz2) : fabsf(delta[AXIS_E]);
+
+    // Path acceleration and jerk, limited so no single axis exceeds its own
+    float accel = b->steps[AXIS_E] ? printAcceleration : travelAcceleration;
+    float jerk = 1e9f;
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        if (!b->steps[a]) continue;
+        float share = fabsf(delta[a]) / b->millimeters;
+        accel = min(accel, maxAcceleration[a] / share);
+        jerk = min(jerk, maxJerk[a] / share);
+    }
+    b->acceleration = accel;
+    b->profile = motionProfile;
+
+    // Cap the cruise speed at the highest rate the step interrupt can sustain
+    float spmLine = b->stepEventCount / b->millimeters;
+    b->jerkSteps = jerk * spmLine;
+    b->nominalSpeed = min(feedrate / 60.0f, STEPPER_MAX_RATE / spmLine);
+    b->nominalRate = max(1UL, (unsigned long)ceilf(b->nominalSpeed * spmLine));
+
+    // Junction deviation: the corner speed at which the centripetal
+    // acceleration of an arc deviating junctionDeviation mm from the corner
+    // stays within the block's acceleration
+    float unit[3] = {0.0f, 0.0f, 0.0f};
+    float vmaxJunction = 0.0f;
+    if (hasXYZ) {
+        for (uint8_t a = 0; a < 3; a++) unit[a] = delta[a] / b->millimeters;
+        if (previousNominalSpeed > 0.0f) {
+            float cosTheta = -(previousUnit[0] * unit[0] + previousUnit[1] * unit[1] +
+                               previousUnit[2] * unit[2]);
+            vmaxJunction = min(previousNominalSpeed, b->nominalSpeed);
+            if (cosTheta > 0.999999f) {
+                vmaxJunction = 0.0f;  // full reversal
+            } else if (cosTheta > -0.999999f) {
+                float sinHalf = sqrtf(0.5f * (1.0f - cosTheta));
+                vmaxJunction = min(vmaxJunction,
+                                   sqrtf(b->acceleration * junctionDeviation * sinHalf / (1.0f - sinHalf)));
+            }
+        }
+    }
+    b->maxEntrySpeed = endstopBits ? 0.0f : vmaxJunction;
+
+    // Publish from rest; the look-ahead raises the entry once the previous
+    // block's exit has been updated to match
+    b->entrySpeed = 0.0f;
+    b->exitSpeed = -1.0f;
+    calculateTrapezoid(b, 0.0f, 0.0f);
+    b->recalculate = true;
+
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) position[a] = targetSteps[a];
+    if (hasXYZ && !endstopBits) {
+        for (uint8_t a = 0; a < 3; a++) previousUnit[a] = unit[a];
+        previousNominalSpeed = b->nominalSpeed;
+    } else {
+        // Extruder-only and homing moves stop at both ends
+        previousNominalSpeed = 0.0f;
+    }
+
+    blockHead = nextBlockIndex(blockHead);
+    recalculate();
+    return true;
+}
+
+PlannerBlock* plannerCurrentBlock() {
+    if (blockHead == blockTail) return nullptr;
+    PlannerBlock* b = &blocks[blockTail];
+    b->busy = true;
+    return b;
+}
+
+void plannerDiscardCurrentBlock() {
+    if (blockHead != blockTail) {
+        blockTail = nextBlockIndex(blockTail);
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <Arduino.h>
+#include "stepper.h"
+
+// Number of queued moves used for look-ahead, must be a power of two
+#define PLANNER_BUFFER_SIZE 8
+// Default path accelerations in mm/s^2 (M204 P/T)
+#define DEFAULT_ACCELERATION        500.0f
+#define DEFAULT_TRAVEL_ACCELERATION 500.0f
+// Default per-axis limits (M201 in mm/s^2, M205 in mm/s^3)
+#define DEFAULT_MAX_ACCEL_XY 500.0f
+#define DEFAULT_MAX_ACCEL_Z  100.0f
+#define DEFAULT_MAX_ACCEL_E  1000.0f
+#define DEFAULT_MAX_JERK_XY  50000.0f
+#define DEFAULT_MAX_JERK_Z   10000.0f
+#define DEFAULT_MAX_JERK_E   100000.0f
+// Allowed deviation from the corner in mm when taking a junction at speed
+#define JUNCTION_DEVIATION 0.05f
+// Lowest step rate the stepper starts or ends a block with
+#define MIN_STEP_RATE 120UL
+
+// Velocity profile used for the acceleration and deceleration ramps
+enum MotionProfile {
+    PROFILE_TRAPEZOID = 0,  // constant acceleration
+    PROFILE_SCURVE = 1      // 7-segment jerk-limited ramps
+};
+
+// Motion limits, persisted with the other EEPROM settings
+extern float maxAcceleration[AXIS_COUNT];  // mm/s^2 per axis (M201)
+extern float maxJerk[AXIS_COUNT];          // mm/s^3 per axis (M205 X/Y/Z/E)
+extern float printAcceleration;            // mm/s^2 for extruding moves (M204 P)
+extern float travelAcceleration;           // mm/s^2 for travel moves (M204 T)
+extern float junctionDeviation;            // mm (M205 J)
+extern uint8_t motionProfile;              // MotionProfile (M205 P)
+
+void resetMotionLimits();
+
+// Rate change over one acceleration or deceleration ramp, prepared by the
+// planner so the step interrupt only needs integer multiplies and shifts.
+// A ramp is jerk-up for jerkTicks, linear, then jerk-down for jerkTicks;
+// a trapezoid ramp has jerkTicks = 0. Times are in STEPPER_TIMER_HZ ticks.
+struct StepRamp {
+    unsigned long duration;         // ticks until the full change is reached
+    unsigned long jerkTicks;        // length of each jerk segment
+    unsigned long jerkCoef;         // Q16 rate change per (t >> jerkShift)^2 / 256
+    unsigned long slopeCoef;        // Q16 rate change per (t >> slopeShift)
+    uint16_t change;                // steps/s over the whole ramp
+    uint16_t jerkChange;            // steps/s at the end of the jerk-up segment
+    uint8_t jerkShift;
+    uint8_t slopeShift;
+};
+
+// One straight move; step data is consumed by the stepper interrupt,
+// speed data is owned by the planner until the block becomes busy.
+struct PlannerBlock {
+    long steps[AXIS_COUNT];        // step count per axis (magnitude)
+    long stepEventCount;           // steps on the longest axis
+    uint8_t dirBits;               // bit n set = axis n moves in negative direction
+    uint8_t endstopBits;           // bit n set = axis n stops at its endstop (homing)
+
+    // Trapezoid in step units, rewritten only while !busy
+    unsigned long initialRate;      // steps/s at block start
+    unsigned long nominalRate;      // steps/s while cruising
+    unsigned long finalRate;        // steps/s at block end
+    long accelerateUntil;           // last step event of the acceleration ramp
+    long decelerateAfter;           // first step event of the deceleration ramp
+    StepRamp accelRamp;             // added to initialRate
+    StepRamp decelRamp;             // taken from the rate reached accelerating
+    float jerkSteps;                // steps/s^3, used for S-curve ramps
+    uint8_t profile;                // MotionProfile
+    volatile bool busy;             // set once the stepper starts this block
+
+    // Path data in mm and mm/s
+    float millimeters;
+    float acceleration;
+    float nominalSpeed;
+    float entrySpeed;
+    float maxEntrySpeed;
+    float exitSpeed;                // exit speed the current trapezoid was built for
+    bool recalculate;
+};
+
+void initPlanner();
+
+// Queue a straight move to an absolute machine position in steps at the
+// given feedrate (mm/min); returns false when the buffer is full. Axes in
+// endstopBits stop early when their endstop triggers; such a block starts
+// and ends at rest, and the position after it must be set again.
+bool plannerBufferSteps(const long targetSteps[AXIS_COUNT], float feedrate,
+                        uint8_t endstopBits = 0);
+// Machine position in steps at the end of the last queued move; this is
+// the authoritative position, mm values are derived from it
+long plannerPosition(uint8_t axis);
+float axisStepsPerMM(uint8_t axis);
+bool plannerFull();
+bool plannerEmpty();
+uint8_t plannerFreeBlocks();
+
+// Resynchronise the planner after G92/G28/M92 changed the position
+void plannerSetPosition(float x, float y, float z, float e);
+// Drop every queued block after an endstop stopped the stepper, moving the
+// position back by their steps and the `unfinished` steps of the stopped
+// block so it matches where the axes are. Assumes no G92 among them.
+void plannerClearQueue(const long unfinished[AXIS_COUNT]);
+
+// Used by the stepper interrupt
+PlannerBlock* plannerCurrentBlock();
+void plannerDiscardCurrentBlock();
@@ -0,0 +1,90 @@
+#include "scheduler.h"
+
+struct Task {
+    const __FlashStringHelper* name;
+    TaskFunction run;
+    uint16_t period;            // ms, 0 = every pass
+    uint8_t priority;
+    bool active;                // running now, possibly waiting in schedulerRun()
+    unsigned long nextRun;      // millis() of the next slot
+    // Statistics since the last report; a task's time includes any tasks
+    // it ran itself while waiting
+    unsigned long runs;
+    unsigned long totalUs;
+    unsigned long maxUs;
+    unsigned int overruns;
+};
+
+static Task tasks[SCHEDULER_MAX_TASKS];
+static uint8_t taskCount = 0;
+static unsigned long statsStart = 0;
+
+static void clearStats(Task& t) {
+    t.runs = 0;
+    t.totalUs = 0;
+    t.maxUs = 0;
+    t.overruns = 0;
+}
+
+void schedulerAdd(const __FlashStringHelper* name, TaskFunction run,
+                  uint16_t periodMs, uint8_t priority) {
+    if (taskCount >= SCHEDULER_MAX_TASKS) return;
+    // Keep the table in priority order; equal priorities run in add order
+    uint8_t i = taskCount++;
+    while (i > 0 && tasks[i - 1].priority > priority) {
+        tasks[i] = tasks[i - 1];
+        i--;
+    }
+    Task& t = tasks[i];
+    t.name = name;
+    t.run = run;
+    t.period = periodMs;
+    t.priority = priority;
+    t.active = false;
+    t.nextRun = millis();
+    clearStats(t);
+    statsStart = millis();
+}
+
+void schedulerRun() {
+    for (uint8_t i = 0; i < taskCount; i++) {
+        Task& t = tasks[i];
+        if (t.active) continue;
+        if (t.period) {
+            unsigned long now = millis();
+            if ((long)(now - t.nextRun) < 0) continue;
+            t.nextRun += t.period;
+            if ((long)(now - t.nextRun) >= 0) {
+                // A whole slot went by; count it and resync instead of
+                // running the task back to back to catch up
+                t.overruns++;
+                t.nextRun = now + t.period;
+            }
+        }
+        t.active = true;
+        unsigned long start = micros();
+        t.run();
+        unsigned long us = micros() - start;
+        t.active = false;
+        t.runs++;
+        t.totalUs += us;
+        if (us > t.maxUs) t.maxUs = us;
+    }
+}
+
+void schedulerReport() {
+    Serial.print(F("Tasks over "));
+    Serial.print(millis() - statsStart);
+    Serial.println(F(" ms"));
+    for (uint8_t i = 0; i < taskCount; i++) {
+        Task& t = tasks[i];
+        Serial.print(t.name);
+        Serial.print(F(" period:")); Serial.print(t.period);
+        Serial.print(F(" runs:")); Serial.print(t.runs);
+        Serial.print(F(" avg:")); Serial.print(t.runs ? t.totalUs / t.runs : 0);
+        Serial.print(F("us max:")); Serial.print(t.maxUs);
+        Serial.print(F("us overruns:")); Serial.println(t.overruns);
+        clearStats(t);
+    }
+    statsStart = millis();
+}
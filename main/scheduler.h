@@ -0,0 +1,19 @@
+#pragma once
+#include <Arduino.h>
+
+// Cooperative scheduler for the main-loop tasks. Each task has a period in
+// ms (0 = every pass) and a priority (lower runs first); every
+// schedulerRun() runs the due tasks in priority order. A task never
+// re-enters itself, so code that has to wait (moves, dwell) can call
+// schedulerRun() to keep the other tasks going.
+#define SCHEDULER_MAX_TASKS 8
+
+typedef void (*TaskFunction)();
+
+void schedulerAdd(const __FlashStringHelper* name, TaskFunction run,
+                  uint16_t periodMs, uint8_t priority);
+void schedulerRun();
+
+// Run count, average/maximum time and overruns (a whole period missed) per
+// task since the previous report; used by M881
+void schedulerReport();
@@ -0,0 +1,147 @@
+#include "serial_rx.h"
+#include "config.h"
+#include "planner.h"
+#include "binary_link.h"
+#include <string.h>
+#include <stdlib.h>
+
+// Line being assembled from the UART ring buffer
+static char rxLine[GCODE_LINE_MAX];
+static uint8_t rxLength = 0;
+static bool rxComment = false;     // inside a ';' comment, not stored
+static bool rxDiscarding = false;  // line overflowed, skip until newline
+static bool rxPending = false;     // rxLine is complete, waiting for a queue slot
+static bool overflowReported = false;
+
+// Complete lines waiting for processGcode()
+static char queue[CMD_QUEUE_SIZE][GCODE_LINE_MAX];
+static uint8_t queueTail = 0;   // oldest line
+static uint8_t queueCount = 0;
+
+uint8_t commandQueueFree() {
+    return CMD_QUEUE_SIZE - queueCount;
+}
+
+bool enqueueCommand(const char* line) {
+    if (queueCount >= CMD_QUEUE_SIZE) return false;
+    uint8_t slot = (queueTail + queueCount) % CMD_QUEUE_SIZE;
+    size_t length = strnlen(line, GCODE_LINE_MAX - 1);
+    memcpy(queue[slot], line, length);
+    queue[slot][length] = '\0';
+    queueCount++;
+    return true;
+}
+
+bool enqueueCommandBytes(const uint8_t* data, uint8_t length) {
+    if (queueCount >= CMD_QUEUE_SIZE || length > GCODE_LINE_MAX) return false;
+    memcpy(queue[(queueTail + queueCount) % CMD_QUEUE_SIZE], data, length);
+    queueCount++;
+    return true;
+}
+
+char* commandQueuePeek() {
+    return commandQueueAt(0);
+}
+
+void commandQueueDiscard() {
+    if (!queueCount) return;
+    queueTail = (queueTail + 1) % CMD_QUEUE_SIZE;
+    queueCount--;
+}
+
+char* commandQueueAt(uint8_t index) {
+    return index < queueCount ? queue[(queueTail + index) % CMD_QUEUE_SIZE] : nullptr;
+}
+
+void commandQueueRemove(uint8_t index) {
+    if (index >= queueCount) return;
+    for (uint8_t i = index; i + 1 < queueCount; i++) {
+        memcpy(queue[(queueTail + i) % CMD_QUEUE_SIZE],
+               queue[(queueTail + i + 1) % CMD_QUEUE_SIZE], GCODE_LINE_MAX);
+    }
+    queueCount--;
+}
+
+// With ADVANCED_OK the host also learns the line number and how many
+// planner blocks (P) and queue slots (B) are still free, so it can keep
+// several lines in flight.
+void sendLineAck(long lineNumber) {
+#ifdef ADVANCED_OK
+    Serial.print(F("ok"));
+    if (lineNumber >= 0) {
+        Serial.print(F(" N"));
+        Serial.print(lineNumber);
+    }
+    Serial.print(F(" P"));
+    Serial.print(plannerFreeBlocks());
+    Serial.print(F(" B"));
+    Serial.println(commandQueueFree());
+#else
+    (void)lineNumber;
+    Serial.println(F("ok"));
+#endif
+}
+
+static long lineNumberOf(const char* line) {
+    while (*line == ' ') line++;
+    if ((*line == 'N' || *line == 'n') && line[1] >= '0' && line[1] <= '9') {
+        return strtol(line + 1, nullptr, 10);
+    }
+    return -1;
+}
+
+// Queue the finished rxLine and acknowledge it. Returns false, leaving
+// rxLine untouched, while the queue has no slot for it.
+static bool lineComplete() {
+    if (rxDiscarding) {
+        Serial.println(F("Error:Line too long"));
+        sendLineAck(-1);
+    } else {
+        rxLine[rxLength] = '\0';
+        const char* p = rxLine;
+        while (*p == ' ' || *p == '\t') p++;
+        // Blank and comment-only lines are acknowledged but not queued
+        if (*p && !enqueueCommand(rxLine)) return false;
+        sendLineAck(lineNumberOf(rxLine));
+    }
+    rxLength = 0;
+    rxComment = false;
+    rxDiscarding = false;
+    return true;
+}
+
+void serialPoll() {
+#ifdef SERIAL_RX_BUFFER_SIZE
+    // A full ring means the interrupt may already have dropped bytes
+    if (Serial.available() >= SERIAL_RX_BUFFER_SIZE - 1) {
+        if (!overflowReported) Serial.println(F("Warning: serial RX overflow"));
+        overflowReported = true;
+    } else {
+        overflowReported = false;
+    }
+#endif
+    if (rxPending) rxPending = !lineComplete();
+    // A full queue only holds back the "ok" of the line after it: the host
+    // may already be sending that line, so it is still read out of the
+    // small UART ring into rxLine. Reading stops once it is complete and
+    // the host is waiting for its "ok". Binary frames stop at a full queue.
+    while (!rxPending && Serial.available()) {
+        if (binaryLinkActive && queueCount >= CMD_QUEUE_SIZE) break;
+        char c = Serial.read();
+        if (binaryLinkActive) {
+            binaryLinkFeed(c);
+        } else if (c == '\n' || c == '\r') {
+            if (rxLength || rxComment || rxDiscarding) rxPending = !lineComplete();
+        } else if (c == ';') {
+            rxComment = true;
+        } else if ((uint8_t)c < ' ' && c != '\t') {
+            // Control characters are never part of a G-code line
+        } else if (!rxComment && !rxDiscarding) {
+            if (rxLength < GCODE_LINE_MAX - 1) {
+                rxLine[rxLength++] = c;
+            } else {
+                rxDiscarding = true;
+            }
+        }
+    }
+}
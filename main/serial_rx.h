@@ -0,0 +1,34 @@
+#pragma once
+#include <Arduino.h>
+#include "parser.h"
+
+// Number of received lines buffered ahead of processGcode()
+#define CMD_QUEUE_SIZE 4
+
+// Move whatever the UART interrupt has buffered into the command queue.
+// Never waits for more bytes; call it every loop and while moves run.
+// Each line is acknowledged with "ok" as soon as it is queued; a line that
+// finds the queue full waits, read but unacknowledged, for a free slot.
+void serialPoll();
+
+// Oldest queued line, or nullptr when the queue is empty. The line stays in
+// its slot (and may be modified in place) until commandQueueDiscard().
+char* commandQueuePeek();
+void commandQueueDiscard();
+// Line `index` places behind the oldest, or nullptr past the end
+char* commandQueueAt(uint8_t index);
+// Drop a line from behind the oldest; the lines after it move up
+void commandQueueRemove(uint8_t index);
+
+// Queue a line from inside the firmware; it is not acknowledged.
+// Returns false when the queue is full.
+bool enqueueCommand(const char* line);
+
+// Queue raw bytes (a decoded binary frame); same rules as enqueueCommand()
+bool enqueueCommandBytes(const uint8_t* data, uint8_t length);
+
+uint8_t commandQueueFree();
+
+// Flow control reply for one received line or frame; lineNumber < 0 when
+// the line carried no N word
+void sendLineAck(long lineNumber);
@@ -1,6 +1,7 @@
 #include "state.h"
 #include <Arduino.h>
 #include "tunes.h"
+#include "motion.h"
 
 PrinterState printer;
 
@@ -11,7 +12,6 @@ void resetPrinterState() {
     printer.heatDoneBeeped = false;
     printer.waitingForHeat = false;
 
-    printer.posX = printer.posY = printer.posZ = printer.posE = 0.0f;
     printer.eStart = 0.0f;
     // -1 indicates progress total not set
     printer.eTotal = -1.0f;
@@ -29,28 +29,24 @@ void resetPrinterState() {
     printer.Kd = 1.2f;
     printer.pwmValue = 0.0f;
     printer.lastOutput = 0.0f;
-    printer.integral = 0.0f;
-    printer.previousError = 0.0f;
-    printer.lastTime = millis();
 
 
     printer.paused = false;
 
     printer.nextX = printer.nextY = printer.nextZ = printer.nextE = 0.0f;
     printer.hasNextMove = false;
-    printer.remStepX = printer.remStepY = printer.remStepZ = printer.remStepE = 0;
-    printer.signX = printer.signY = printer.signZ = printer.signE = 1;
 
     printer.currentCmd[0] = '\0';
 }
 
 void updateProgress() {
     if (printer.eTotal > 0.0f) {
-        if (printer.eStart > printer.posE) {
+        float posE = axisPosition(AXIS_E);
+        if (printer.eStart > posE) {
             // Avoid negative delta when retracting
-            printer.eStart = printer.posE;
+            printer.eStart = posE;
         }
-        float delta = printer.posE - printer.eStart;
+        float delta = posE - printer.eStart;
         if (delta >= printer.eTotal) {
             printer.progress = 100;
             // Mark print as complete until user confirms
@@ -11,7 +11,7 @@ struct PrinterState {
     float lastOutput;
 
     // 馬達與進度
-    float posX, posY, posZ, posE;
+    // 目前座標由規劃器以整數步數保存，mm 值用 axisPosition() 換算
     float eStart, eTotal;
     int progress;
     bool eStartSynced;
@@ -24,10 +24,8 @@ struct PrinterState {
     int movingDir;
     unsigned long lastMoveTime;
 
-    // PID
+    // PID gains; the controller's own state lives in temp_control.cpp
     float Kp, Ki, Kd;
-    float integral, previousError;
-    unsigned long lastTime;
 
     // 暫停狀態 (M0)
     bool paused;
@@ -35,8 +33,6 @@ struct PrinterState {
     // Upcoming and remaining move tracking
     float nextX, nextY, nextZ, nextE; // next target or relative move
     bool hasNextMove;
-    long remStepX, remStepY, remStepZ, remStepE; // remaining steps during move
-    int signX, signY, signZ, signE; // direction of current move
 
     // Last processed command for LCD serial monitor
     char currentCmd[33];
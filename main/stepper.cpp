@@ -0,0 +1,349 @@
+#include "stepper.h"
+#include "pins.h"
+#include "config.h"
+#include "planner.h"
+#include "fastio.h"
+#include "index_seq.h"
+#if defined(__AVR__)
+#include <avr/interrupt.h>
+#endif
+
+// Poll period while the queue is empty
+static const unsigned long IDLE_INTERVAL = STEPPER_TIMER_HZ / 1000;
+static const unsigned long MIN_INTERVAL = STEPPER_TIMER_HZ / STEPPER_MAX_RATE;
+
+// STEPPER_TIMER_HZ / rate without dividing in the interrupt: one entry
+// per 64 steps/s from INTERVAL_TABLE_MIN_RATE up, in 1/16 ticks, linearly
+// interpolated. Below that steps are over 1 ms apart and the divide is
+// affordable.
+#define INTERVAL_TABLE_SHIFT 6
+static const unsigned long INTERVAL_TABLE_MIN_RATE = 1024;
+static const int INTERVAL_TABLE_FIRST = INTERVAL_TABLE_MIN_RATE >> INTERVAL_TABLE_SHIFT;
+static const int INTERVAL_TABLE_SIZE = (STEPPER_MAX_RATE >> INTERVAL_TABLE_SHIFT) - INTERVAL_TABLE_FIRST + 2;
+
+// Unnarrowed entry, so the range check below sees the real value; the
+// first entry is the largest
+constexpr unsigned long intervalTableRaw(int i) {
+    return (16 * STEPPER_TIMER_HZ + ((unsigned long)(i + INTERVAL_TABLE_FIRST) << (INTERVAL_TABLE_SHIFT - 1))) /
+           ((unsigned long)(i + INTERVAL_TABLE_FIRST) << INTERVAL_TABLE_SHIFT);
+}
+static_assert(intervalTableRaw(0) <= 0xFFFF, "interval table entries overflow");
+constexpr uint16_t intervalTableEntry(int i) {
+    return (uint16_t)intervalTableRaw(i);
+}
+
+template <class Seq> struct IntervalTable;
+template <int... I> struct IntervalTable<IndexSeq<I...>> {
+    static const uint16_t values[sizeof...(I)];
+};
+template <int... I>
+const uint16_t IntervalTable<IndexSeq<I...>>::values[sizeof...(I)] PROGMEM = {
+    intervalTableEntry(I)...
+};
+typedef IntervalTable<MakeIndexSeq<INTERVAL_TABLE_SIZE>::type> Intervals;
+
+static unsigned long intervalFor(unsigned long rate) {
+    if (rate < INTERVAL_TABLE_MIN_RATE) return STEPPER_TIMER_HZ / rate;
+    if (rate > STEPPER_MAX_RATE) rate = STEPPER_MAX_RATE;
+    uint8_t i = (rate >> INTERVAL_TABLE_SHIFT) - INTERVAL_TABLE_FIRST;
+    uint16_t a = pgm_read_word(&Intervals::values[i]);
+    uint16_t b = pgm_read_word(&Intervals::values[i + 1]);
+    uint8_t frac = rate & ((1 << INTERVAL_TABLE_SHIFT) - 1);
+    uint16_t sixteenths = a - (uint16_t)(((unsigned long)(a - b) * frac) >> INTERVAL_TABLE_SHIFT);
+    return (sixteenths + 8) >> 4;
+}
+
+// Interrupt-side state for the running block
+static PlannerBlock* current = nullptr;
+static long errX, errY, errZ, errE;
+static long stepEventsDone = 0;
+static unsigned long accelTime = 0;      // ticks spent in the acceleration ramp
+static unsigned long decelTime = 0;      // ticks spent in the deceleration ramp
+static unsigned long accelReachedRate = 0;
+static unsigned long nominalInterval = 0;
+static bool motorsEnabled = false;
+static volatile uint16_t extrudedSteps = 0;
+static volatile uint8_t endstopHits = 0;
+static volatile uint8_t endstopTrigger = 0;  // axes whose interrupt fired (M120)
+static volatile uint8_t haltAxes = 0;        // axes that stopped the last move
+static long haltUnfinished[AXIS_COUNT];
+
+// Rate change `ticks` into a ramp (see StepRamp): two 32-bit multiplies
+// at most, no floating point or division
+static unsigned long rampChange(const StepRamp& r, unsigned long ticks) {
+    if (ticks >= r.duration) return r.change;
+    if (ticks < r.jerkTicks) {
+        uint16_t u = ticks >> r.jerkShift;
+        return (r.jerkCoef * (uint16_t)(((unsigned long)u * u) >> 8)) >> 16;
+    }
+    unsigned long rest = r.duration - ticks;
+    if (rest < r.jerkTicks) {
+        uint16_t u = rest >> r.jerkShift;
+        unsigned long missing = (r.jerkCoef * (uint16_t)(((unsigned long)u * u) >> 8)) >> 16;
+        return missing < r.change ? r.change - missing : 0;
+    }
+    return r.jerkChange + ((r.slopeCoef * ((ticks - r.jerkTicks) >> r.slopeShift)) >> 16);
+}
+
+// Raise or drop the step lines of the given axes. On the CNC shield X/Y/Z
+// step pins all sit on PORTD, so they switch together in one port write.
+static inline void writeStepPins(bool x, bool y, bool z, bool e, bool level) {
+#ifdef FASTIO_DIRECT
+    if (FastPin<STEP_PIN_X>::portAddr == FastPin<STEP_PIN_Y>::portAddr &&
+        FastPin<STEP_PIN_X>::portAddr == FastPin<STEP_PIN_Z>::portAddr) {
+        uint8_t bits = (x ? FastPin<STEP_PIN_X>::mask : 0) |
+                       (y ? FastPin<STEP_PIN_Y>::mask : 0) |
+                       (z ? FastPin<STEP_PIN_Z>::mask : 0);
+        if (level) FastPin<STEP_PIN_X>::port() |= bits;
+        else FastPin<STEP_PIN_X>::port() &= (uint8_t)~bits;
+    } else
+#endif
+    {
+        if (x) FastPin<STEP_PIN_X>::write(level);
+        if (y) FastPin<STEP_PIN_Y>::write(level);
+        if (z) FastPin<STEP_PIN_Z>::write(level);
+    }
+#ifndef SIMULATE_EXTRUDER
+    if (e) FastPin<STEP_PIN_E>::write(level);
+#endif
+}
+
+uint8_t readEndstops(uint8_t axes) {
+    uint8_t hit = 0;
+    if ((axes & _BV(AXIS_X)) && !FastPin<ENDSTOP_PIN_X>::read()) hit |= _BV(AXIS_X);
+    if ((axes & _BV(AXIS_Y)) && !FastPin<ENDSTOP_PIN_Y>::read()) hit |= _BV(AXIS_Y);
+    if ((axes & _BV(AXIS_Z)) && !FastPin<ENDSTOP_PIN_Z>::read()) hit |= _BV(AXIS_Z);
+    return hit;
+}
+
+static void startBlock(PlannerBlock* b) {
+    FastPin<DIR_PIN_X>::write(!(b->dirBits & _BV(AXIS_X)));
+    FastPin<DIR_PIN_Y>::write(!(b->dirBits & _BV(AXIS_Y)));
+    FastPin<DIR_PIN_Z>::write(!(b->dirBits & _BV(AXIS_Z)));
+#ifndef SIMULATE_EXTRUDER
+    FastPin<DIR_PIN_E>::write(!(b->dirBits & _BV(AXIS_E)));
+#endif
+    if (!motorsEnabled) {
+        FastPin<MOTOR_ENABLE_PIN>::low();
+        motorsEnabled = true;
+    }
+    errX = errY = errZ = errE = b->stepEventCount / 2;
+    stepEventsDone = 0;
+    accelTime = decelTime = 0;
+    accelReachedRate = b->initialRate;
+    nominalInterval = intervalFor(b->nominalRate);
+}
+
+// Stop the running block where it is and record the steps it still had
+// to make, recovered from the Bresenham counters: err = total/2 - n*steps
+// + done*total after n step events
+static void haltCurrentBlock() {
+    long total = current->stepEventCount;
+    long errs[AXIS_COUNT] = {errX, errY, errZ, errE};
+    for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+        long done = (long)(((int64_t)errs[a] - total / 2 + (int64_t)stepEventsDone * current->steps[a]) / total);
+        long left = current->steps[a] - done;
+        haltUnfinished[a] = (current->dirBits & _BV(a)) ? -left : left;
+    }
+    haltAxes = endstopTrigger & current->dirBits;
+    endstopTrigger = 0;
+    current = nullptr;
+    plannerDiscardCurrentBlock();
+}
+
+// Body of the step interrupt; emits at most one step event and returns the
+// number of timer ticks until it should run again
+static unsigned long stepperTick() {
+    if (haltAxes) return IDLE_INTERVAL;
+    if (!current) {
+        current = plannerCurrentBlock();
+        if (!current) {
+            endstopTrigger = 0;  // nothing moving to stop
+            if (motorsEnabled) {
+                // Release drivers once the queue drains, as moves always did
+                FastPin<MOTOR_ENABLE_PIN>::high();
+                motorsEnabled = false;
+            }
+            return IDLE_INTERVAL;
+        }
+        startBlock(current);
+    }
+    if (endstopTrigger) {
+        // Only an axis moving toward its endstop (negative) can hit it; an
+        // edge on any other, e.g. a switch bouncing as the carriage leaves
+        // it after G28, is ignored. Homing stops at the endstops by itself.
+        if (!current->endstopBits && (endstopTrigger & current->dirBits)) {
+            haltCurrentBlock();
+            return IDLE_INTERVAL;
+        }
+        endstopTrigger = 0;
+    }
+
+    // Homing: an axis stops at its endstop, the block ends once all have
+    uint8_t stopped = 0;
+    if (current->endstopBits) {
+        stopped = endstopHits | readEndstops(current->endstopBits & ~endstopHits);
+        endstopHits = stopped;
+        if ((stopped & current->endstopBits) == current->endstopBits) {
+            current = nullptr;
+            plannerDiscardCurrentBlock();
+            return IDLE_INTERVAL;
+        }
+    }
+
+    long total = current->stepEventCount;
+    bool doX = false, doY = false, doZ = false, doE = false;
+    if (current->steps[AXIS_X]) { errX -= current->steps[AXIS_X]; if (errX < 0) { errX += total; doX = true; } }
+    if (current->steps[AXIS_Y]) { errY -= current->steps[AXIS_Y]; if (errY < 0) { errY += total; doY = true; } }
+    if (current->steps[AXIS_Z]) { errZ -= current->steps[AXIS_Z]; if (errZ < 0) { errZ += total; doZ = true; } }
+    if (current->steps[AXIS_E]) { errE -= current->steps[AXIS_E]; if (errE < 0) { errE += total; doE = true; } }
+    if (stopped & _BV(AXIS_X)) doX = false;
+    if (stopped & _BV(AXIS_Y)) doY = false;
+    if (stopped & _BV(AXIS_Z)) doZ = false;
+
+    if (doE && !(current->dirBits & _BV(AXIS_E))) extrudedSteps++;
+    if (doX || doY || doZ || doE) {
+        writeStepPins(doX, doY, doZ, doE, HIGH);
+        delayMicroseconds(STEP_PULSE_US);
+        writeStepPins(doX, doY, doZ, doE, LOW);
+    }
+
+    // Accelerate along the block's ramp, hold nominal, then decelerate from
+    // whatever rate acceleration reached. The planner shaped the ramps as
+    // trapezoid or S-curve; here both are the same integer evaluation.
+    unsigned long interval;
+    long i = stepEventsDone++;
+    if (i <= current->accelerateUntil) {
+        unsigned long rate = current->initialRate + rampChange(current->accelRamp, accelTime);
+        if (rate > current->nominalRate) rate = current->nominalRate;
+        accelReachedRate = rate;
+        interval = intervalFor(rate);
+        accelTime += interval;
+    } else if (i > current->decelerateAfter) {
+        unsigned long dv = rampChange(current->decelRamp, decelTime);
+        unsigned long rate = (dv < accelReachedRate) ? accelReachedRate - dv : 0;
+        if (rate < current->finalRate) rate = current->finalRate;
+        interval = intervalFor(rate);
+        decelTime += interval;
+    } else {
+        interval = nominalInterval;
+    }
+
+    if (stepEventsDone >= total) {
+        current = nullptr;
+        plannerDiscardCurrentBlock();
+    }
+    return max(interval, MIN_INTERVAL);
+}
+
+uint16_t stepperTakeExtrudedSteps() {
+    noInterrupts();
+    uint16_t steps = extrudedSteps;
+    extrudedSteps = 0;
+    interrupts();
+    return steps;
+}
+
+void stepperEndstopTriggered(uint8_t axis) {
+    endstopTrigger |= _BV(axis);
+}
+
+uint8_t stepperHaltedBy(long unfinished[AXIS_COUNT]) {
+    uint8_t axes = haltAxes;
+    if (axes) {
+        for (uint8_t a = 0; a < AXIS_COUNT; a++) unfinished[a] = haltUnfinished[a];
+    }
+    return axes;
+}
+
+void stepperResume() {
+    haltAxes = 0;
+}
+
+uint8_t stepperTakeEndstopHits() {
+    noInterrupts();
+    uint8_t hits = endstopHits;
+    endstopHits = 0;
+    interrupts();
+    return hits;
+}
+
+bool stepperIdle() {
+    // Blocks stay in the planner until their last step has been emitted
+    return plannerEmpty();
+}
+
+#if defined(__AVR__)
+
+// Ticks still to wait when an interval exceeds the 16-bit compare range
+static unsigned long pendingTicks = 0;
+static volatile uint16_t maxIsrTicks = 0;
+
+static inline void scheduleNext(unsigned long ticks) {
+    if (ticks > 0xFFFFUL) {
+        pendingTicks = ticks - 0xFFFFUL;
+        ticks = 0xFFFFUL;
+    }
+    // Never program a compare value the counter has already passed
+    uint16_t minTicks = TCNT1 + 16;
+    OCR1A = max((uint16_t)ticks, minTicks);
+}
+
+ISR(TIMER1_COMPA_vect) {
+    if (pendingTicks) {
+        unsigned long ticks = pendingTicks;
+        pendingTicks = 0;
+        scheduleNext(ticks);
+        return;
+    }
+    scheduleNext(stepperTick());
+    // CTC mode restarted the counter at the compare match, so it now holds
+    // the time since the interrupt was due, latency included
+    uint16_t spent = TCNT1;
+    if (spent > maxIsrTicks) maxIsrTicks = spent;
+}
+
+uint16_t stepperTakeMaxIsrTicks() {
+    noInterrupts();
+    uint16_t ticks = maxIsrTicks;
+    maxIsrTicks = 0;
+    interrupts();
+    return ticks;
+}
+
+void initStepper() {
+    noInterrupts();
+    // Timer1 in CTC mode, prescaler 8 -> 2 MHz at 16 MHz F_CPU
+    TCCR1A = 0;
+    TCCR1B = _BV(WGM12) | _BV(CS11);
+    TCNT1 = 0;
+    OCR1A = IDLE_INTERVAL;
+    TIMSK1 |= _BV(OCIE1A);
+    interrupts();
+}
+
+void stepperService() {}
+
+#else
+
+// No hardware timer off-target: run the interrupt body from the main loop
+// against micros(), keeping the same tick arithmetic as Timer1.
+static unsigned long nextTickAt = 0;
+
+void initStepper() {
+    nextTickAt = micros() * (STEPPER_TIMER_HZ / 1000000UL);
+}
+
+void stepperService() {
+    unsigned long now = micros() * (STEPPER_TIMER_HZ / 1000000UL);
+    while ((long)(now - nextTickAt) >= 0) {
+        nextTickAt += stepperTick();
+    }
+}
+
+unsigned long stepperTimerTicks() {
+    // Only moves on once stepperTick() has returned
+    return nextTickAt;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+
+// Axis indices shared by the step generator and the motion code
+enum Axis {
+    AXIS_X = 0,
+    AXIS_Y,
+    AXIS_Z,
+    AXIS_E,
+    AXIS_COUNT
+};
+
+// Step timer runs at 2 MHz (0.5 us per tick)
+#define STEPPER_TIMER_HZ    2000000UL
+// Upper bound on step events per second on the longest axis. Check the
+// interrupt time M881 reports on the board before raising it.
+#define STEPPER_MAX_RATE    5000UL
+
+void initStepper();
+
+// True when no block is queued or running
+bool stepperIdle();
+
+// Forward extruder steps emitted since the last call; feeds the heater
+// model's extrusion cooling term
+uint16_t stepperTakeExtrudedSteps();
+
+// Axes among `axes` whose endstop is triggered (switches pull the input low)
+uint8_t readEndstops(uint8_t axes);
+// Axes whose endstop stopped a homing block since the last call
+uint8_t stepperTakeEndstopHits();
+
+// Endstop monitoring during normal moves (M120). The pin-change interrupt
+// calls stepperEndstopTriggered(); if the running move takes that axis
+// toward its endstop, the next step tick stops it and holds the stepper
+// until the main loop calls stepperResume(). stepperHaltedBy() reports the
+// stop. Homing blocks ignore triggers, since they stop at the endstops
+// themselves.
+void stepperEndstopTriggered(uint8_t axis);
+// Axes that stopped a move (0 = none); `unfinished` gets the signed steps
+// of the stopped block that were never made
+uint8_t stepperHaltedBy(long unfinished[AXIS_COUNT]);
+void stepperResume();
+
+#if defined(__AVR__)
+// Longest step interrupt since the last call, in timer ticks (0.5 us)
+uint16_t stepperTakeMaxIsrTicks();
+#endif
+
+// Host builds have no Timer1; call this often to run the simulated timer
+void stepperService();
+
+#if !defined(__AVR__)
+// Timer tick (STEPPER_TIMER_HZ) the running step event was due at, so host
+// tools can timestamp pin edges as the real timer would place them
+unsigned long stepperTimerTicks();
+#endif
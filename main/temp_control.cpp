@@ -5,57 +5,537 @@
 #include "state.h"
 #include "tunes.h"
 #include "config.h"
+#include "fastio.h"
+#include "gcode.h"
+#include "stepper.h"
+#if defined(__AVR__)
+#include <avr/interrupt.h>
+#endif
+
+#if defined(__AVR__)
+// The thermistor is sampled in the background: Timer0 overflow (~976 Hz,
+// already running for millis()) auto-triggers a conversion, and the ADC
+// interrupt median-filters each sample against the previous two before
+// summing it. readThermistor() takes the sum once per tick, so every
+// reading averages ~97 samples. Free-running at 9.6 kHz would cost the
+// stepper ISR far more time for no useful gain on a thermal signal.
+static volatile uint32_t adcSum = 0;
+static volatile uint16_t adcCount = 0;
+
+// Stop summing if nobody collects for a while (~4 s), so the sum cannot wrap
+static const uint16_t ADC_MAX_SAMPLES = 4096;
+
+ISR(ADC_vect) {
+    static uint16_t prev1 = 0, prev2 = 0;
+    uint16_t v = ADC;
+    uint16_t lo = min(prev1, prev2);
+    uint16_t hi = max(prev1, prev2);
+    uint16_t med = (v < lo) ? lo : (v > hi) ? hi : v;
+    prev2 = prev1;
+    prev1 = v;
+    if (adcCount < ADC_MAX_SAMPLES) {
+        adcSum += med;
+        adcCount++;
+    }
+}
+
+void initTemperatureSensor() {
+    uint8_t channel = (uint8_t)(tempPin - A0);
+    DIDR0 |= _BV(channel);                   // digital buffer off on the sensor pin
+    ADMUX = _BV(REFS0) | (channel & 0x07);   // AVcc reference
+    ADCSRB = _BV(ADTS2);                     // trigger on Timer0 overflow
+    ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) |
+             _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);  // 125 kHz ADC clock
+}
+
+#if !(defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT))
+// Average of the samples since the last call, in ADC counts x16
+static uint16_t takeSensorSample() {
+    static uint16_t last = 0;
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t sum = adcSum;
+    uint16_t count = adcCount;
+    adcSum = 0;
+    adcCount = 0;
+    SREG = sreg;
+    if (count) last = (uint16_t)((sum * 16 + count / 2) / count);
+    return last;
+}
+#endif
+#else
+void initTemperatureSensor() {}
+
+#if !(defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT))
+static uint16_t takeSensorSample() {
+    return (uint16_t)analogRead(tempPin) << 4;
+}
+#endif
+#endif
+
+// Controller state shared between the control tick and the main loop.
+// The tick only touches these; readTemperature() and serviceHeater()
+// copy them to and from printer.* with interrupts off, so no float is
+// ever read half-written on either side.
+static volatile float heaterTarget = 0.0f;
+static volatile float pidKp = 0.0f, pidKi = 0.0f, pidKd = 0.0f;
+static volatile float measuredTemp = 0.0f;
+static volatile float heaterOutput = 0.0f;
+static volatile int sensorRaw = 0;
+static volatile bool heaterOverheat = false;
+#define HEATER_MODEL_DEFAULTS { DEFAULT_HEATER_POWER, DEFAULT_BLOCK_HEAT_CAP, \
+    DEFAULT_SENSOR_RESPONSE, DEFAULT_AMBIENT_XFER, DEFAULT_FILAMENT_HEAT_CAP }
+static HeaterModel tickModel = HEATER_MODEL_DEFAULTS;
+static uint8_t tickMode = HEATER_PID;
+static float tickStepsPerMM_E = 25.0f;
+
+HeaterModel heaterModel = HEATER_MODEL_DEFAULTS;
+uint8_t heaterMode = HEATER_PID;
+
+void resetHeaterModel() {
+    HeaterModel defaults = HEATER_MODEL_DEFAULTS;
+    heaterModel = defaults;
+    heaterMode = HEATER_PID;
+}
+
+// Relay (Astrom-Hagglund) autotune for M303. The output swings between
+// bias+d and bias-d each time the temperature crosses the target; bias is
+// nudged until the high and low halves take equal time, and the ultimate
+// gain Ku = 4d / (pi * a) and period Tu are read off the oscillation.
+// The tick owns `relay` while autotuneState is AUTOTUNE_RUNNING; the main
+// loop only reads it with interrupts off.
+enum { AUTOTUNE_IDLE, AUTOTUNE_RUNNING, AUTOTUNE_DONE, AUTOTUNE_FAILED };
+static volatile uint8_t autotuneState = AUTOTUNE_IDLE;
 
-// Simple 100k thermistor using B=3950 equation
+struct RelayTune {
+    float target;
+    uint16_t tick;          // control steps since the start
+    uint16_t t1, t2;        // steps at the last switch to low / high
+    uint16_t tHigh, tLow;   // length of the last high / low half
+    int16_t bias, d;        // PWM units, 0..255
+    float tMax, tMin;
+    bool heating;
+    uint8_t cycle, cycles;
+    float Ku, Tu;
+};
+static RelayTune relay;
+
+// Relay halves shorter than this are ignored as noise around the target
+static const uint16_t AUTOTUNE_MIN_HALF = (uint16_t)(5.0f / TEMP_CONTROL_DT);
+static const uint16_t AUTOTUNE_TIMEOUT = (uint16_t)(1200.0f / TEMP_CONTROL_DT);
+static const float AUTOTUNE_MAX_OVERSHOOT = 25.0f;
+
+// One relay step; returns the heater output in PWM units
+static float autotuneStep(float temp) {
+    RelayTune &r = relay;
+    uint16_t t = ++r.tick;
+    if (temp > r.target + AUTOTUNE_MAX_OVERSHOOT) {
+        heaterOverheat = true;
+        autotuneState = AUTOTUNE_FAILED;
+        return 0.0f;
+    }
+    if (t > AUTOTUNE_TIMEOUT) {
+        autotuneState = AUTOTUNE_FAILED;
+        return 0.0f;
+    }
+    r.tMax = max(r.tMax, temp);
+    r.tMin = min(r.tMin, temp);
+
+    if (r.heating && temp > r.target && (uint16_t)(t - r.t2) > AUTOTUNE_MIN_HALF) {
+        r.heating = false;
+        r.t1 = t;
+        r.tHigh = r.t1 - r.t2;
+        r.tMax = r.target;
+    }
+    if (!r.heating && temp < r.target && (uint16_t)(t - r.t1) > AUTOTUNE_MIN_HALF) {
+        r.heating = true;
+        r.t2 = t;
+        r.tLow = r.t2 - r.t1;
+        if (r.cycle > 0) {
+            long sum = (long)r.tLow + r.tHigh;
+            r.bias += (int16_t)((long)r.d * ((long)r.tHigh - r.tLow) / sum);
+            r.bias = constrain(r.bias, 20, 235);
+            r.d = (r.bias > 127) ? 254 - r.bias : r.bias;
+            if (r.cycle > 2) {
+                r.Ku = (4.0f * r.d) / ((float)M_PI * (r.tMax - r.tMin) * 0.5f);
+                r.Tu = sum * TEMP_CONTROL_DT;
+            }
+        }
+        r.cycle++;
+        r.tMin = r.target;
+        if (r.cycle > r.cycles) {
+            autotuneState = AUTOTUNE_DONE;
+            return 0.0f;
+        }
+    }
+    return r.heating ? r.bias + r.d : r.bias - r.d;
+}
+
+#if defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT)
+// Simulated hot end: the block gains the heater's share of SIM_HEATER_POWER
+// and loses heat to the air (Newton cooling, plus an optional fan) and to
+// the filament pushed through it. The thermistor follows the block with a
+// first-order lag and reads with a little noise, so controllers face the
+// same lag and jitter they would on the machine.
+static float extrusionRate = 0.0f;  // mm/s over the last control step
+
+static float simulatedHotEnd() {
+    static float block = SIM_AMBIENT_TEMP;
+    static float sensor = SIM_AMBIENT_TEMP;
+    static uint16_t noiseState = 0xACE1;
+    const float dt = TEMP_CONTROL_DT;
+
+    float power = heaterOutput * (SIM_HEATER_POWER / 255.0f);
+    float xfer = SIM_AMBIENT_XFER + SIM_FAN_XFER + SIM_FILAMENT_HEAT_CAP * extrusionRate;
+    block += (power - xfer * (block - SIM_AMBIENT_TEMP)) / SIM_BLOCK_HEAT_CAP * dt;
+    sensor += (block - sensor) * (dt / SIM_SENSOR_TAU);
+
+    // xorshift noise, uniform in +-SIM_SENSOR_NOISE
+    noiseState ^= noiseState << 7;
+    noiseState ^= noiseState >> 9;
+    noiseState ^= noiseState << 8;
+    float noise = ((int16_t)noiseState / 32768.0f) * SIM_SENSOR_NOISE;
+    return sensor + noise;
+}
+#endif
+
+// Thermistor reading via the compile-time table in thermistor.h
 // Returns temperature in Celsius
 float readThermistor(int pin) {
 #if defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT)
-    // In debug mode simulate a simple linear temperature ramp
-    static float simTemp = 25.0f;
-    if (printer.setTemp > simTemp) {
-        simTemp += 1.0f;  // increase 1 degC per call
-        if (simTemp > printer.setTemp) simTemp = printer.setTemp;
-    } else if (printer.setTemp <= 0.0f && simTemp > 25.0f) {
-        simTemp -= 1.0f;  // cool down when heater off
-        if (simTemp < 25.0f) simTemp = 25.0f;
-    }
-    printer.rawTemp = (int)(simTemp * 2);  // dummy value for debugging
-    return simTemp;
+    (void)pin;
+    float temp = simulatedHotEnd();
+    sensorRaw = (int)(temp * 2);  // dummy value for debugging
+    return temp;
 #else
-    int raw = analogRead(pin);
-    printer.rawTemp = raw; // keep raw reading for debugging
-    float voltage = raw * 5.0f / 1023.0f;
-    if (voltage <= 0.0f) {
+    (void)pin;  // the sampler is bound to tempPin in initTemperatureSensor()
+    uint16_t adc16 = takeSensorSample();
+    sensorRaw = adc16 >> 4; // keep raw reading for debugging
+    if (adc16 < 16) {
         return -1000.0f; // invalid reading
     }
-    float resistance = (5.0f - voltage) * SERIES_RESISTOR / voltage;
-    float tempK = 1.0f / (log(resistance / THERMISTOR_NOMINAL) / BCOEFFICIENT +
-                         1.0f / (TEMPERATURE_NOMINAL + 273.15f));
-    return tempK - 273.15f;
+    return thermistorDeciCelsius(adc16) * 0.1f;
 #endif
 }
 
-// External state variables defined in main.ino
-extern unsigned long heatStableStart;
-extern const unsigned long stableHoldTime;
+// Model learning for M306 T: full power from cold to the target while the
+// sensor curve is sampled at evenly spaced points. When the buffer fills,
+// every other point is dropped and the spacing doubles, so the samples
+// always span most of the heat-up. The fit itself runs in
+// serviceModelLearn().
+static volatile uint8_t learnState = AUTOTUNE_IDLE;
 
+static const uint8_t MODEL_LEARN_SAMPLES = 5;  // odd, so halving keeps the ends
 
-// Pins from pins.h
-extern const int heaterPin;
-extern const int tempPin;
-extern const int buzzerPin;
+struct ModelLearn {
+    float target, ambient;
+    uint16_t tick;
+    uint16_t firstTick;     // step of samples[0]
+    uint16_t interval;      // steps between samples
+    uint16_t nextSample;
+    float samples[MODEL_LEARN_SAMPLES];
+    uint8_t count;
+};
+static ModelLearn learn;
 
-void readTemperature() {
-    float tempC = readThermistor(tempPin);
-    static float filtered = 0.0f;
-    static bool filterInit = false;
-    if (!filterInit) {
-        filtered = tempC;
-        filterInit = true;
+// Sampling starts once the sensor has clearly left ambient, so its lag
+// only shifts the curve rather than bending it
+static const float MODEL_LEARN_START_RISE = 20.0f;
+
+static float learnStep(float temp) {
+    ModelLearn &l = learn;
+    uint16_t t = ++l.tick;
+    if (temp > l.target + AUTOTUNE_MAX_OVERSHOOT) {
+        heaterOverheat = true;
+        learnState = AUTOTUNE_FAILED;
+        return 0.0f;
+    }
+    if (t > AUTOTUNE_TIMEOUT) {
+        learnState = AUTOTUNE_FAILED;
+        return 0.0f;
+    }
+    if (temp >= l.target) {
+        learnState = (l.count >= 3) ? AUTOTUNE_DONE : AUTOTUNE_FAILED;
+        return 0.0f;
+    }
+    if (l.count == 0) {
+        if (temp >= l.ambient + MODEL_LEARN_START_RISE) {
+            l.firstTick = t;
+            l.samples[l.count++] = temp;
+            l.nextSample = t + l.interval;
+        }
+    } else if (t == l.nextSample) {
+        if (l.count == MODEL_LEARN_SAMPLES) {
+            for (uint8_t i = 1; i <= MODEL_LEARN_SAMPLES / 2; i++) l.samples[i] = l.samples[2 * i];
+            l.count = MODEL_LEARN_SAMPLES / 2 + 1;
+            l.interval *= 2;
+        } else {
+            l.samples[l.count++] = temp;
+        }
+        l.nextSample = l.firstTick + l.count * l.interval;
+    }
+    return 255.0f;
+}
+
+// Two-node model (block and sensor) run alongside the real heater every
+// step, whichever controller is active, and pulled towards the measured
+// temperature so it never drifts far from reality
+struct ModelState {
+    float block, sensor, ambient;
+    bool valid;
+};
+static ModelState model;
+static const float MODEL_SMOOTHING = 0.5f;
+
+static void updateModel(float temp, float eRate) {
+    const float dt = TEMP_CONTROL_DT;
+    const HeaterModel &p = tickModel;
+    if (!model.valid) {
+        model.block = model.sensor = temp;
+        model.ambient = (temp < 40.0f) ? temp : 25.0f;
+        model.valid = true;
+        return;
+    }
+    float power = heaterOutput * (p.heaterPower / 255.0f);
+    float loss = (p.ambientXfer + p.filamentHeatCap * eRate) * (model.block - model.ambient);
+    model.block += (power - loss) / p.blockHeatCap * dt;
+    model.sensor += (model.block - model.sensor) * min(p.sensorResponse * dt, 1.0f);
+    float err = temp - model.sensor;
+    model.block += err * MODEL_SMOOTHING;
+    model.sensor += err * MODEL_SMOOTHING;
+}
+
+// Power that brings the modelled block to the target by the next step and
+// holds it against the air and the filament, as a 0..1 ratio. The sensor
+// lags the block, so stopping on the block avoids the overshoot a
+// sensor-only controller needs its output caps for.
+static float modelOutput(float target, float eRate) {
+    const HeaterModel &p = tickModel;
+    float hold = (p.ambientXfer + p.filamentHeatCap * eRate) * (target - model.ambient);
+    float reach = (target - model.block) * p.blockHeatCap / TEMP_CONTROL_DT;
+    return constrain((hold + reach) / p.heaterPower, 0.0f, 1.0f);
+}
+
+// PID with the distance-based output caps; returns PWM 0..255. The gains
+// act on a 0..1 ratio of the cap, which is PID_HOLD_CAP near the target.
+static float pidIntegral = 0.0f;
+static float pidPreviousError = 0.0f;
+static float pidDerivative = 0.0f;
+static float pidLastTemp = 0.0f;
+static float pidTarget = 0.0f;
+static const int PID_HOLD_CAP = 80;     // PWM cap within 3 degC of the target
+static const float PID_D_SMOOTHING = 0.1f;
+
+static void pidReset(float temp, float target) {
+    pidIntegral = 0.0f;
+    pidPreviousError = target - temp;
+    pidDerivative = 0.0f;
+    pidLastTemp = temp;
+    pidTarget = target;
+}
+
+static float pidOutput(float temp, float target) {
+    const float dt = TEMP_CONTROL_DT;
+    if (target != pidTarget) pidReset(temp, target);
+    float error = target - temp;
+    // Low-passed over about a second: raw, the sensor's tick-to-tick noise
+    // times Kd swings the output across its whole range
+    pidDerivative += ((error - pidPreviousError) / dt - pidDerivative) * PID_D_SMOOTHING;
+    pidPreviousError = error;
+    float pd = pidKp * error + pidKd * pidDerivative;
+
+    // Anti-windup: the I term alone stays within the 0..1 ratio it can act
+    // on. Unbounded, the heat-up at full power fills the integral and the
+    // output stays at its cap long after the target is reached.
+    pidIntegral += error * dt;
+    if (pidKi > 0.0f) pidIntegral = constrain(pidIntegral, 0.0f, 1.0f / pidKi);
+
+    // PID output：範圍 0.0~1.0
+    float rawOutput = pd + pidKi * pidIntegral;
+    rawOutput = max(rawOutput, 0.0f);  // 不讓 PID 為負數
+
+    float rampRate = (temp - pidLastTemp) / dt;
+    pidLastTemp = temp;
+
+    float deltaT = target - temp;
+    int maxOut = 255;
+
+    if (deltaT > 20.0f) {
+        maxOut = 255;  // 全力加熱
+    } else if (deltaT > 10.0f) {
+        maxOut = 200;
+    } else if (deltaT > 3.0f) {
+        maxOut = (rampRate > 1.0f) ? 80 : 120;
+    } else {
+        maxOut = PID_HOLD_CAP;
+    }
+
+    // 限制輸出比例不超過1，再乘 maxOut
+    float outputRatio = constrain(rawOutput, 0.0f, 1.0f);
+    return outputRatio * maxOut;
+}
+
+// Step response of each heat-up, measured on the control tick and printed by
+// serviceHeater() once it settles: 10-90 % rise time, overshoot past the
+// target, and the time from which the reading stays within
+// RESPONSE_SETTLE_BAND for RESPONSE_SETTLE_HOLD. Gives a like-for-like
+// figure when comparing gains or controllers, in simulation or on the
+// machine.
+enum { RESPONSE_IDLE, RESPONSE_MEASURING, RESPONSE_DONE };
+static volatile uint8_t responseState = RESPONSE_IDLE;
+
+struct StepResponse {
+    float start, target, peak;
+    uint16_t tick, rise10, rise90, inBand;
+    bool settled;
+};
+static StepResponse response;
+
+static const float RESPONSE_MIN_STEP = 10.0f;
+static const float RESPONSE_SETTLE_BAND = 1.0f;
+static const uint16_t RESPONSE_SETTLE_HOLD = (uint16_t)(10.0f / TEMP_CONTROL_DT);
+
+static void trackResponse(float temp, float target) {
+    StepResponse &r = response;
+    if (target != r.target) {
+        r.target = target;
+        r.start = r.peak = temp;
+        r.tick = r.rise10 = r.rise90 = r.inBand = 0;
+        r.settled = false;
+        responseState = (target > temp + RESPONSE_MIN_STEP) ? RESPONSE_MEASURING : RESPONSE_IDLE;
+    }
+    if (responseState != RESPONSE_MEASURING) return;
+
+    uint16_t t = ++r.tick;
+    float span = r.target - r.start;
+    r.peak = max(r.peak, temp);
+    if (!r.rise10 && temp >= r.start + 0.1f * span) r.rise10 = t;
+    if (!r.rise90 && temp >= r.start + 0.9f * span) r.rise90 = t;
+    if (fabs(temp - r.target) <= RESPONSE_SETTLE_BAND) {
+        if (!r.inBand) r.inBand = t;
+        if ((uint16_t)(t - r.inBand) >= RESPONSE_SETTLE_HOLD) {
+            r.settled = true;
+            responseState = RESPONSE_DONE;
+        }
     } else {
-        filtered = filtered * 0.7f + tempC * 0.3f;
+        r.inBand = 0;
     }
-    printer.currentTemp = filtered;
+    if (t >= AUTOTUNE_TIMEOUT) responseState = RESPONSE_DONE;
+}
+
+// One control step with the fixed TEMP_CONTROL_DT. Runs from the Timer0
+// tick on AVR, so it must not print, beep or call millis()-based logic.
+static void temperatureControlStep() {
+    static uint8_t overshootCount = 0;
+
+    float eRate = stepperTakeExtrudedSteps() / (tickStepsPerMM_E * TEMP_CONTROL_DT);
+#if defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT)
+    extrusionRate = eRate;
+#endif
+    float temp = readThermistor(tempPin);
+    measuredTemp = temp;
+    float target = heaterTarget;
+    updateModel(temp, eRate);
+
+    float output;
+    bool tuning = autotuneState == AUTOTUNE_RUNNING || learnState == AUTOTUNE_RUNNING;
+    trackResponse(temp, (tuning || heaterOverheat) ? 0.0f : target);
+    if (tuning) {
+        output = (autotuneState == AUTOTUNE_RUNNING) ? autotuneStep(temp) : learnStep(temp);
+        pidReset(temp, target);
+    } else if (target <= 0.0f || heaterOverheat) {
+        overshootCount = 0;
+        pidReset(temp, target);
+        output = 0.0f;
+    } else if (temp > target + 15.0f && ++overshootCount >= 3) {
+        heaterOverheat = true;  // reported and cleared by serviceHeater()
+        output = 0.0f;
+    } else {
+        if (temp <= target + 15.0f) overshootCount = 0;
+        if (tickMode == HEATER_MODEL) {
+            output = modelOutput(target, eRate) * 255.0f;
+            pidReset(temp, target);
+        } else {
+            output = pidOutput(temp, target);
+        }
+    }
+
+    heaterOutput = output;
+#if !(defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT))
+    setHeaterPWM((int)output);
+#endif
+}
+
+#if defined(__AVR__)
+// Timer1 now drives the steppers, which takes hardware PWM away from the
+// heater on D10. A slow software PWM runs from the Timer0 compare B
+// interrupt instead (~976 Hz tick, 128 levels, ~7.6 Hz period), which is
+// plenty for a thermal load.
+static volatile uint8_t heaterDuty = 0;
+
+// The same interrupt paces the PID: every TEMP_CONTROL_TICKS ticks it runs
+// temperatureControlStep() with interrupts re-enabled, so the stepper ISR
+// and the PWM phase keep running underneath it. A long move, homing or a
+// blocking command in loop() no longer stalls the heater.
+ISR(TIMER0_COMPB_vect) {
+    static uint8_t phase = 0;
+    static bool on = false;
+    static uint8_t ticks = 0;
+    static bool busy = false;
+    phase = (phase + 1) & 0x7F;
+    bool want = phase < heaterDuty;
+    if (want != on) {
+        FastPin<HEATER_PIN>::write(want);
+        on = want;
+    }
+
+    if (ticks < TEMP_CONTROL_TICKS) ticks++;
+    if (ticks < TEMP_CONTROL_TICKS || busy) return;
+    ticks = 0;
+    busy = true;
+    sei();
+    temperatureControlStep();
+    cli();
+    busy = false;
+}
+
+void initHeaterPWM() {
+    digitalWrite(heaterPin, LOW);
+    // Timer0 already runs for millis(); only hook its compare B interrupt
+    OCR0B = 128;
+    TIMSK0 |= _BV(OCIE0B);
+}
+
+void setHeaterPWM(int value) {
+    heaterDuty = (uint8_t)(constrain(value, 0, 255) >> 1);
+}
+#else
+void initHeaterPWM() {}
+
+void setHeaterPWM(int value) {
+    analogWrite(heaterPin, value);
+}
+#endif
+
+// External state variables defined in main.ino
+extern unsigned long heatStableStart;
+extern const unsigned long stableHoldTime;
+extern void saveSettingsToEEPROM();
+extern float stepsPerMM_E;
+
+// Publish the latest reading from the control tick to printer.*
+void readTemperature() {
+#if !defined(__AVR__)
+    // No timer here; the 100 ms task tick stands in for it
+    temperatureControlStep();
+#endif
+    noInterrupts();
+    printer.currentTemp = measuredTemp;
+    printer.rawTemp = sensorRaw;
+    printer.lastOutput = heaterOutput;  // 儲存實際PWM輸出
+    interrupts();
+    printer.pwmValue = printer.lastOutput;
+    printer.heaterOn = printer.lastOutput > 0;
 
     #ifdef DEBUG_LOGS
     static unsigned long lastLog = 0;
@@ -64,7 +544,7 @@ void readTemperature() {
         float voltage = printer.rawTemp * 5.0f / 1023.0f;
 
         float error = printer.setTemp - printer.currentTemp;
-        float pwm = printer.pwmValue; // 請確認在 controlHeater 裡有設這值
+        float pwm = printer.pwmValue;
 
         Serial.print(now);
         Serial.print(", ");
@@ -84,7 +564,7 @@ void readTemperature() {
         Serial.print(", ");
         Serial.print(error);
         Serial.print(", ");
-        Serial.println(printer.lastOutput);  // 建議你增加這個變數儲存 output
+        Serial.println(printer.lastOutput);
 
         lastLog = now;
     }
@@ -93,9 +573,225 @@ void readTemperature() {
     // sensor error handling removed
 }
 
-void controlHeater() {
+// Hand the target and gains to the control tick
+static void pushHeaterSettings() {
+    noInterrupts();
+    heaterTarget = printer.setTemp;
+    pidKp = printer.Kp;
+    pidKi = printer.Ki;
+    pidKd = printer.Kd;
+    tickModel = heaterModel;
+    tickMode = heaterMode;
+    tickStepsPerMM_E = stepsPerMM_E;
+    interrupts();
+}
+
+static bool autotuneSave = false;
+static uint8_t autotuneReported = 0;
+
+bool startAutotune(float target, uint8_t cycles, bool save) {
+    if (heaterTuning() || target <= 0.0f || target > 300.0f) return false;
+    printer.setTemp = target;
+    printer.heatDoneBeeped = false;
+    autotuneSave = save;
+    autotuneReported = 0;
+    noInterrupts();
+    relay.target = target;
+    relay.tick = relay.t1 = relay.t2 = 0;
+    relay.tHigh = relay.tLow = 0;
+    relay.bias = relay.d = 127;
+    relay.tMax = relay.tMin = target;
+    relay.heating = true;
+    relay.cycle = 0;
+    relay.cycles = cycles;
+    relay.Ku = relay.Tu = 0.0f;
+    heaterTarget = target;
+    autotuneState = AUTOTUNE_RUNNING;
+    interrupts();
+    return true;
+}
+
+bool startModelLearn(float target) {
+    if (heaterTuning() || target <= 0.0f || target > 300.0f) return false;
+    float ambient = printer.currentTemp;
+    if (ambient > 50.0f || ambient < 0.0f) return false;
+    printer.setTemp = target;
+    printer.heatDoneBeeped = false;
+    noInterrupts();
+    learn.target = target;
+    learn.ambient = ambient;
+    learn.tick = 0;
+    learn.interval = (uint16_t)(1.0f / TEMP_CONTROL_DT);
+    learn.count = 0;
+    model.ambient = ambient;
+    heaterTarget = target;
+    learnState = AUTOTUNE_RUNNING;
+    interrupts();
+    return true;
+}
+
+bool heaterTuning() {
+    return autotuneState == AUTOTUNE_RUNNING || learnState == AUTOTUNE_RUNNING;
+}
+
+static void printGains(const __FlashStringHelper* label, float kp, float ki, float kd) {
+    Serial.print(F("echo:")); Serial.print(label);
+    Serial.print(F(" Kp:")); Serial.print(kp, 4);
+    Serial.print(F(" Ki:")); Serial.print(ki, 4);
+    Serial.print(F(" Kd:")); Serial.println(kd, 4);
+}
+
+// Progress and results of M303; returns true while it owns the heater
+static bool serviceAutotune() {
+    noInterrupts();
+    uint8_t state = autotuneState;
+    RelayTune r = relay;
+    interrupts();
+
+    if (state == AUTOTUNE_RUNNING) {
+        if (printer.setTemp != r.target) {  // M104 during the tune cancels it
+            noInterrupts();
+            autotuneState = AUTOTUNE_IDLE;
+            interrupts();
+            sendReply(F("PID autotune aborted"));
+            return false;
+        }
+        if (r.cycle != autotuneReported && r.cycle > 3) {
+            autotuneReported = r.cycle;
+            Serial.print(F("echo:Autotune cycle ")); Serial.print(r.cycle - 1);
+            Serial.print(F(" bias:")); Serial.print(r.bias);
+            Serial.print(F(" d:")); Serial.print(r.d);
+            Serial.print(F(" Ku:")); Serial.print(r.Ku);
+            Serial.print(F(" Tu:")); Serial.println(r.Tu);
+        }
+        return true;
+    }
+
+    autotuneState = AUTOTUNE_IDLE;
+    printer.setTemp = 0;
+    pushHeaterSettings();
+    if (state == AUTOTUNE_FAILED || r.Ku <= 0.0f || r.Tu <= 0.0f) {
+        sendReply(F("PID autotune failed"));
+        return false;
+    }
+    // Ku is in PWM per degC. pidOutput() scales its 0..1 ratio by the cap,
+    // which is PID_HOLD_CAP in the band the relay oscillated in, so the
+    // gains are converted to ratio per degC of that cap
+    float ku = r.Ku / PID_HOLD_CAP;
+    float kp = 0.6f * ku;                       // Ziegler-Nichols
+    float ki = 2.0f * kp / r.Tu;
+    float kd = kp * r.Tu / 8.0f;
+    float tlKp = ku / 2.2f;                     // Tyreus-Luyben, less overshoot
+    printGains(F("Tyreus-Luyben"), tlKp, tlKp / (2.2f * r.Tu), tlKp * r.Tu / 6.3f);
+    printGains(F("PID autotune done"), kp, ki, kd);
+    if (autotuneSave) {
+        printer.Kp = kp;
+        printer.Ki = ki;
+        printer.Kd = kd;
+        saveSettingsToEEPROM();
+        sendReply(F("PID gains saved"));
+    }
+    return false;
+}
+
+// Fit of the M306 T heat-up; returns true while it owns the heater
+static bool serviceModelLearn() {
+    noInterrupts();
+    uint8_t state = learnState;
+    ModelLearn l = learn;
+    interrupts();
+
+    if (state == AUTOTUNE_RUNNING) {
+        if (printer.setTemp != l.target) {
+            noInterrupts();
+            learnState = AUTOTUNE_IDLE;
+            interrupts();
+            sendReply(F("Model learning aborted"));
+            return false;
+        }
+        return true;
+    }
+
+    learnState = AUTOTUNE_IDLE;
+    printer.setTemp = 0;
+    pushHeaterSettings();
+    if (state == AUTOTUNE_FAILED || l.count < 3) {
+        sendReply(F("Model learning failed"));
+        return false;
+    }
+    // Full-power heating follows T(t) = Tinf - (Tinf - Ta) * exp(-t / tau);
+    // three evenly spaced samples give tau and Tinf directly. Take the
+    // widest evenly spaced triple that ends at the last sample.
+    uint8_t stride = (l.count - 1) / 2;
+    uint8_t first = l.count - 1 - 2 * stride;
+    float t0 = l.samples[first];
+    float d1 = l.samples[first + stride] - t0;
+    float d2 = l.samples[l.count - 1] - l.samples[first + stride];
+    float ratio = (d1 > 0.0f) ? d2 / d1 : 0.0f;
+    if (ratio <= 0.0f || ratio >= 1.0f) {
+        sendReply(F("Model learning failed"));
+        return false;
+    }
+    float tau = -(stride * l.interval * TEMP_CONTROL_DT) / logf(ratio);
+    float tInf = t0 + d1 / (1.0f - ratio);
+    float xfer = heaterModel.heaterPower / (tInf - l.ambient);
+    // Where the fitted curve leaves ambient, relative to power-on, is the
+    // sensor's lag behind the block
+    float lag = (l.firstTick + first * l.interval) * TEMP_CONTROL_DT +
+                tau * logf((tInf - t0) / (tInf - l.ambient));
+    heaterModel.ambientXfer = xfer;
+    heaterModel.blockHeatCap = tau * xfer;
+    heaterModel.sensorResponse = 1.0f / max(lag, 0.5f);
+    pushHeaterSettings();
+
+    Serial.print(F("echo:Model C:")); Serial.print(heaterModel.blockHeatCap, 2);
+    Serial.print(F(" R:")); Serial.print(heaterModel.sensorResponse, 3);
+    Serial.print(F(" A:")); Serial.println(heaterModel.ambientXfer, 4);
+    sendReply(F("Model learned; M306 S1 to use it, M500 to keep it"));
+    return false;
+}
+
+static void reportResponse() {
+    noInterrupts();
+    StepResponse r = response;
+    responseState = RESPONSE_IDLE;
+    interrupts();
+    Serial.print(F("echo:Heat-up ")); Serial.print(r.start, 1);
+    Serial.print(F("->")); Serial.print(r.target, 1);
+    Serial.print(F(" rise:")); Serial.print((r.rise90 - r.rise10) * TEMP_CONTROL_DT, 1);
+    Serial.print(F("s overshoot:")); Serial.print(max(r.peak - r.target, 0.0f), 1);
+    Serial.print(F("C settle:"));
+    if (r.settled) {
+        Serial.print(r.inBand * TEMP_CONTROL_DT, 1);
+        Serial.println(F("s"));
+    } else {
+        Serial.println(F("none"));
+    }
+}
+
+// Main-loop side of heater control: fault reports, the heat-up timeout and
+// the "temperature reached" tune. The PID itself runs from the timer tick.
+void serviceHeater() {
     static unsigned long heatStart = 0;
 
+    if (responseState == RESPONSE_DONE) reportResponse();
+
+    if ((autotuneState != AUTOTUNE_IDLE && serviceAutotune()) ||
+        (learnState != AUTOTUNE_IDLE && serviceModelLearn())) {
+        heatStart = 0;
+        return;
+    }
+
+    if (heaterOverheat) {
+        printer.setTemp = 0;
+        printer.heaterOn = false;
+        heatStart = 0;
+        pushHeaterSettings();
+        heaterOverheat = false;
+        Serial.println(F("ERROR: Overshoot"));
+        return;
+    }
+
     if (printer.setTemp > 0.0f) {
         unsigned long now = millis();
 
@@ -103,79 +799,20 @@ void controlHeater() {
             heatStart = now;
         }
 
-        static int overshootCount = 0;
-        if (printer.currentTemp > printer.setTemp + 15.0f) {
-            overshootCount++;
-            if (overshootCount >= 3) {
-#if !(defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT))
-                analogWrite(heaterPin, 0);
-#endif
-                printer.setTemp = 0;
-                printer.heaterOn = false;
-                Serial.println(F("ERROR: Overshoot"));
-                heatStart = 0;
-                return;
-            }
-        } else {
-            overshootCount = 0;
-        }
-
         if (fabs(printer.currentTemp - printer.setTemp) < 2.0f) {
             heatStart = now; // reset timer once near target
         }
 
         if (heatStart > 0 && now - heatStart > 180000 && printer.eTotal <= 0) {
-#if !(defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT))
-            analogWrite(heaterPin, 0);
-#endif
             printer.setTemp = 0;
             printer.heaterOn = false;
             heatStart = 0;
+            pushHeaterSettings();
             Serial.println(F("ERROR: Heat timeout"));
             return;
         }
 
-        float elapsed = (now - printer.lastTime) / 1000.0f;
-        elapsed = max(elapsed, 0.001f);
-        printer.lastTime = now;
-
-        float error = printer.setTemp - printer.currentTemp;
-        printer.integral += error * elapsed;
-        float derivative = (error - printer.previousError) / elapsed;
-        printer.previousError = error;
-
-        // PID output：範圍 0.0~1.0
-        float rawOutput = printer.Kp * error + printer.Ki * printer.integral + printer.Kd * derivative;
-        rawOutput = max(rawOutput, 0.0f);  // 不讓 PID 為負數
-
-        static float lastTemp = 0.0f;
-        float rampRate = (printer.currentTemp - lastTemp) / elapsed;
-        lastTemp = printer.currentTemp;
-
-        float deltaT = printer.setTemp - printer.currentTemp;
-        int maxOut = 255;
-
-        if (deltaT > 20.0f) {
-            maxOut = 255;  // 全力加熱
-        } else if (deltaT > 10.0f) {
-            maxOut = 200;
-        } else if (deltaT > 3.0f) {
-            maxOut = (rampRate > 1.0f) ? 80 : 120;
-        } else {
-            maxOut = 80;
-        }
-
-        // 限制輸出比例不超過1，再乘 maxOut
-        float outputRatio = constrain(rawOutput, 0.0f, 1.0f);
-        float scaledOutput = outputRatio * maxOut;
-
-        printer.lastOutput = scaledOutput;  // 儲存實際PWM輸出
-        printer.pwmValue = scaledOutput;
-
-#if !(defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT))
-        analogWrite(heaterPin, (int)scaledOutput);
-#endif
-        printer.heaterOn = scaledOutput > 0;
+        pushHeaterSettings();
 
         // 穩定判斷 + 音效提示
         if (abs(printer.currentTemp - printer.setTemp) < 1.0f) {
@@ -194,14 +831,10 @@ void controlHeater() {
             heatStableStart = 0;
         }
     } else {
-#if !(defined(SIMULATE_HEATER) || defined(SIMULATE_GCODE_INPUT))
-        analogWrite(heaterPin, 0);
-#endif
+        pushHeaterSettings();
         printer.heaterOn = false;
         printer.heatDoneBeeped = false;
         heatStableStart = 0;
         heatStart = 0;
     }
 }
-
-
@@ -1,12 +1,58 @@
 #pragma once
+#include <stdint.h>
+#include "thermistor.h"
 
+// The heater PID runs every TEMP_CONTROL_TICKS Timer0 ticks (1.024 ms each
+// at 16 MHz), i.e. about every 100 ms, with this fixed time step in seconds
+#define TEMP_CONTROL_TICKS 98
+#define TEMP_CONTROL_DT    (TEMP_CONTROL_TICKS * 0.001024f)
 
-#define SERIES_RESISTOR     10000.0f
-#define THERMISTOR_NOMINAL  100000.0f
-#define BCOEFFICIENT        3950.0f
-#define TEMPERATURE_NOMINAL 25.0f
+// Simulated hot end for SIMULATE_HEATER (typical 40 W E3D-style block)
+#define SIM_HEATER_POWER      40.0f    // W at full PWM
+#define SIM_BLOCK_HEAT_CAP    12.0f    // J/K, block, nozzle and cartridge
+#define SIM_AMBIENT_XFER      0.06f    // W/K to still air
+#define SIM_FAN_XFER          0.0f     // W/K extra from a fan on the block
+#define SIM_FILAMENT_HEAT_CAP 0.0056f  // J/K per mm of 1.75 mm PLA
+#define SIM_SENSOR_TAU        2.0f     // s, thermistor lag behind the block
+#define SIM_SENSOR_NOISE      0.1f     // degC peak
+#define SIM_AMBIENT_TEMP      25.0f
 
+// Thermal model for the model-based controller (M306). The heater block is
+// one lumped mass, the sensor follows it with a first-order lag, and heat
+// leaves to the air and to the filament being pushed through.
+#define DEFAULT_HEATER_POWER       40.0f    // W at full PWM
+#define DEFAULT_BLOCK_HEAT_CAP     16.0f    // J/K
+#define DEFAULT_SENSOR_RESPONSE    0.5f     // 1/s
+#define DEFAULT_AMBIENT_XFER       0.08f    // W/K
+#define DEFAULT_FILAMENT_HEAT_CAP  0.0056f  // J/K per mm of 1.75 mm PLA
+
+struct HeaterModel {
+    float heaterPower;      // W
+    float blockHeatCap;     // J/K
+    float sensorResponse;   // 1/s
+    float ambientXfer;      // W/K
+    float filamentHeatCap;  // J/K/mm
+};
+
+enum HeaterMode {
+    HEATER_PID = 0,     // PID with the distance-based output caps
+    HEATER_MODEL = 1    // model feed-forward, full power until the last moment
+};
+
+extern HeaterModel heaterModel;     // M306 P/C/R/A/H
+extern uint8_t heaterMode;          // HeaterMode (M306 S)
+
+void resetHeaterModel();
+void initTemperatureSensor();
 float readThermistor(int pin);
 void readTemperature();
-void controlHeater();
+void serviceHeater();
+// M303 relay autotune; save stores the Ziegler-Nichols gains to EEPROM
+bool startAutotune(float target, uint8_t cycles, bool save);
+// M306 T: measure the thermal model with one full-power heat-up from cold
+bool startModelLearn(float target);
+// True while M303 or M306 T owns the heater
+bool heaterTuning();
+void initHeaterPWM();
+void setHeaterPWM(int value);
 extern const unsigned long stableHoldTime;
@@ -0,0 +1,27 @@
+#include "thermistor.h"
+#include "index_seq.h"
+
+static const int TABLE_SIZE = 1024 / THERMISTOR_TABLE_STEP + 1;
+
+template <class Seq> struct ThermistorTable;
+template <int... I> struct ThermistorTable<IndexSeq<I...>> {
+    static const int16_t values[sizeof...(I)];
+};
+// Every entry is a constant expression, so the table is computed by the
+// compiler and placed in flash; nothing is evaluated at run time
+template <int... I>
+const int16_t ThermistorTable<IndexSeq<I...>>::values[sizeof...(I)] PROGMEM = {
+    thermistorTableEntry(I * THERMISTOR_TABLE_STEP)...
+};
+
+typedef ThermistorTable<MakeIndexSeq<TABLE_SIZE>::type> Table;
+
+int16_t thermistorDeciCelsius(uint16_t adc16) {
+    const uint8_t shift = 4 + THERMISTOR_TABLE_SHIFT;  // adc16 units per entry
+    uint16_t i = adc16 >> shift;
+    if (i >= TABLE_SIZE - 1) return (int16_t)pgm_read_word(&Table::values[TABLE_SIZE - 1]);
+    int16_t a = (int16_t)pgm_read_word(&Table::values[i]);
+    int16_t b = (int16_t)pgm_read_word(&Table::values[i + 1]);
+    uint8_t frac = adc16 & ((1 << shift) - 1);
+    return a + (int16_t)(((int32_t)(b - a) * frac) >> shift);
+}
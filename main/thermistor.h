@@ -0,0 +1,98 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+// Voltage divider on the temperature pin: R = SERIES_RESISTOR * (1023 - raw) / raw
+#define SERIES_RESISTOR 10000.0
+
+// Thermistor models for THERMISTOR_TYPE (config.h)
+//   1  100k NTC, B = 3950 (default)
+//   2  100k Semitec 104GT-2, B = 4267
+//   3  10k NTC, B = 3950
+//   99 custom Steinhart-Hart, THERMISTOR_SH_A/B/C in config.h
+#ifndef THERMISTOR_TYPE
+#define THERMISTOR_TYPE 1
+#endif
+
+#if THERMISTOR_TYPE == 1
+#define THERMISTOR_NOMINAL  100000.0
+#define BCOEFFICIENT        3950.0
+#elif THERMISTOR_TYPE == 2
+#define THERMISTOR_NOMINAL  100000.0
+#define BCOEFFICIENT        4267.0
+#elif THERMISTOR_TYPE == 3
+#define THERMISTOR_NOMINAL  10000.0
+#define BCOEFFICIENT        3950.0
+#elif THERMISTOR_TYPE == 99
+#if !defined(THERMISTOR_SH_A) || !defined(THERMISTOR_SH_B) || !defined(THERMISTOR_SH_C)
+#error "THERMISTOR_TYPE 99 needs THERMISTOR_SH_A, THERMISTOR_SH_B and THERMISTOR_SH_C"
+#endif
+#else
+#error "Unknown THERMISTOR_TYPE"
+#endif
+#define TEMPERATURE_NOMINAL 25.0
+
+// Readings outside this range are clamped, in 0.1 degC
+#define THERMISTOR_MIN_DECI (-550)
+#define THERMISTOR_MAX_DECI 5000
+
+// One table entry per 2^THERMISTOR_TABLE_SHIFT ADC counts (4); the curve
+// is steep at the hot end, coarser steps cost over 1 degC of interpolation
+#define THERMISTOR_TABLE_SHIFT 2
+#define THERMISTOR_TABLE_STEP  (1 << THERMISTOR_TABLE_SHIFT)
+
+// Natural log usable in constant expressions (C++11 constexpr: one return
+// statement per function). x is scaled into [1, 2) by powers of two, then
+// ln(m) = 2 * atanh((m - 1) / (m + 1)) is summed as a series; with
+// |y| <= 1/3 twenty terms are far below float precision.
+namespace thermistor_detail {
+constexpr double atanhSeries(double y2, double term, int n) {
+    return n > 41 ? 0.0 : term / n + atanhSeries(y2, term * y2, n + 2);
+}
+constexpr double lnMantissa(double y) {
+    return 2.0 * atanhSeries(y * y, y, 1);
+}
+constexpr double lnScaled(double x, int k) {
+    return x >= 2.0 ? lnScaled(x * 0.5, k + 1) :
+           x < 1.0  ? lnScaled(x * 2.0, k - 1) :
+           k * 0.69314718055994531 + lnMantissa((x - 1.0) / (x + 1.0));
+}
+}  // namespace thermistor_detail
+
+constexpr double constLn(double x) {
+    return thermistor_detail::lnScaled(x, 0);
+}
+
+// Bounds hold for a 32-bit double too, as on AVR
+static_assert(constLn(2.0) > 0.69314 && constLn(2.0) < 0.69315, "constLn(2)");
+static_assert(constLn(0.001) > -6.9078 && constLn(0.001) < -6.9077, "constLn(0.001)");
+
+// Temperature in degC of the thermistor at resistance r (ohms)
+constexpr double thermistorCelsius(double r) {
+#if THERMISTOR_TYPE == 99
+    return 1.0 / (THERMISTOR_SH_A + THERMISTOR_SH_B * constLn(r) +
+                  THERMISTOR_SH_C * constLn(r) * constLn(r) * constLn(r)) - 273.15;
+#else
+    return 1.0 / (constLn(r / THERMISTOR_NOMINAL) / BCOEFFICIENT +
+                  1.0 / (TEMPERATURE_NOMINAL + 273.15)) - 273.15;
+#endif
+}
+
+// Table value for a raw ADC reading, clamped and rounded to 0.1 degC
+constexpr int16_t clampDeci(double c) {
+    return c * 10.0 >= THERMISTOR_MAX_DECI ? THERMISTOR_MAX_DECI :
+           c * 10.0 <= THERMISTOR_MIN_DECI ? THERMISTOR_MIN_DECI :
+           (int16_t)(c * 10.0 + (c >= 0.0 ? 0.5 : -0.5));
+}
+// The thermistor sits on the supply side: an open sensor (raw 0) reads as
+// the coldest value and a shorted one (raw 1023) as the hottest
+constexpr int16_t thermistorTableEntry(int raw) {
+    return raw <= 0 ? THERMISTOR_MIN_DECI :
+           raw >= 1023 ? THERMISTOR_MAX_DECI :
+           clampDeci(thermistorCelsius(SERIES_RESISTOR * (1023 - raw) / raw));
+}
+
+// Temperature in 0.1 degC for an ADC reading scaled by 16 (0..16368), so
+// oversampled sums can be passed without losing their extra resolution.
+// Interpolates the compile-time table; a few integer operations.
+int16_t thermistorDeciCelsius(uint16_t adc16);
@@ -1,12 +1,9 @@
 #include "tunes.h"
 #include "pins.h"
 #include "state.h"
-#include <LiquidCrystal_I2C.h>
 
 #ifndef NO_TUNES
 
-extern LiquidCrystal_I2C lcd;
-
 // Completion tune selected at compile time
 #if defined(USE_TUNE_MARIO)
 static const int compNotes[] = {262, 262, 0, 262, 0, 196, 262, 0, 0, 0, 294, 0, 330};
@@ -30,42 +27,57 @@ static const int compDur[]   = {150,150,150,150,150,150,150,150,150,150,150,150,
 static const int heatNotes[] = {880, 988, 1047};
 static const int heatDur[]   = {150, 150, 300};
 
+// Gap between notes, on top of each note's length
+static const int NOTE_GAP = 50;
+
+static const int *seqNotes = 0;     // 0 = nothing playing
+static const int *seqDurs = 0;
+static uint8_t seqLength = 0;
+static uint8_t seqIndex = 0;
+static unsigned long noteStart = 0;
+
+static void startNote() {
+    if (seqNotes[seqIndex] == 0) {
+        noTone(buzzerPin);
+    } else {
+        tone(buzzerPin, seqNotes[seqIndex], seqDurs[seqIndex]);
+    }
+    noteStart = millis();
+}
+
 void playTune(int tune) {
-    const int *notes = compNotes;
-    const int *durs = compDur;
-    int length = sizeof(compNotes)/sizeof(int);
-    const char *label = COMP_LABEL;
+    seqNotes = compNotes;
+    seqDurs = compDur;
+    seqLength = sizeof(compNotes)/sizeof(int);
 
     if (tune == TUNE_HEAT_DONE) {
-        notes = heatNotes;
-        durs = heatDur;
-        length = sizeof(heatNotes)/sizeof(int);
-        label = "Heat";
+        seqNotes = heatNotes;
+        seqDurs = heatDur;
+        seqLength = sizeof(heatNotes)/sizeof(int);
     }
 
-    for (int i = 0; i < length; i++) {
-        if (notes[i] == 0) {
-            noTone(buzzerPin);
-        } else {
-            tone(buzzerPin, notes[i], durs[i]);
-        }
-        delay(durs[i] + 50);
+    seqIndex = 0;
+    startNote();
+}
+
+void tuneService() {
+    if (!seqNotes) return;
+    if (millis() - noteStart < (unsigned long)(seqDurs[seqIndex] + NOTE_GAP)) return;
+    if (++seqIndex >= seqLength) {
+        noTone(buzzerPin);
+        seqNotes = 0;
+        return;
     }
-    noTone(buzzerPin);
-    delay(500);
+    startNote();
+}
+
+bool tunePlaying() {
+    return seqNotes != 0;
 }
 #endif // NO_TUNES
 
-// Simple one-shot beep for alerts when tunes are disabled
+// Simple one-shot beep for alerts when tunes are disabled; tone() stops
+// the buzzer by itself after the duration
 void simpleBeep(int pin, int freq, int duration_ms) {
-    long period_us = 1000000L / freq;
-    long halfPeriod = period_us / 2;
-    long cycles = (long)duration_ms * 1000L / period_us;
-
-    for (long i = 0; i < cycles; i++) {
-        digitalWrite(pin, HIGH);
-        delayMicroseconds(halfPeriod);
-        digitalWrite(pin, LOW);
-        delayMicroseconds(halfPeriod);
-    }
+    tone(pin, freq, duration_ms);
 }
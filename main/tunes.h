@@ -42,11 +42,18 @@ enum TuneType {
     TUNE_COUNT
 };
 
+// Tunes play in the background: playTune() only starts the sequence and
+// tuneService(), run every few ms by the scheduler, moves to the next note
+// when the current one is over. Starting a tune stops the one playing.
 #ifndef NO_TUNES
 void playTune(int tune);
+void tuneService();
+bool tunePlaying();
 #else
 inline void playTune(int) {}
+inline void tuneService() {}
+inline bool tunePlaying() { return false; }
 #endif
 
-// Short beep helper used when tunes are disabled
+// Short beep helper used when tunes are disabled; returns immediately
 void simpleBeep(int pin, int freq, int duration_ms);
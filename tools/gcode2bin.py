@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""Convert a .gcode file to the firmware's binary move protocol (M880).
+
+G0/G1 moves become packed MOVE frames carrying absolute step targets;
+every other command is wrapped in a GCODE frame so it runs in order.
+The stream ends with an EXIT frame that puts the firmware back in text
+mode.
+
+    gcode2bin.py part.gcode -o part.bin          # write frames to a file
+    gcode2bin.py part.gcode --port /dev/ttyUSB0  # stream to the printer
+
+--steps must match the firmware's M92 settings, since step targets are
+computed here. Streaming needs pyserial.
+"""
+import argparse
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+FRAME_MOVE = 0x01
+FRAME_GCODE = 0x02
+FRAME_EXIT = 0x03
+AXES = "XYZE"
+WORD = re.compile(r"([A-Za-z])\s*([-+]?(?:\d+\.?\d*|\.\d+))?")
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE, as crc16Update() in binary_link.cpp."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def frame(kind, seq, payload=b""):
+    body = bytes([kind, seq & 0xFF, len(payload)]) + payload
+    return bytes([SYNC]) + body + struct.pack("<H", crc16(body))
+
+
+class Encoder:
+    def __init__(self, steps_per_mm):
+        self.spm = steps_per_mm
+        self.pos = [0.0] * 4          # mm, unrounded target per axis
+        self.sent = [0] * 4           # last step target sent, the firmware's int32 step position
+        self.absolute = True
+        self.relative_e = False
+        self.feedrate = 0
+        self.seq = 0
+        self.frames = []
+
+    def emit(self, kind, payload=b""):
+        self.frames.append(frame(kind, self.seq, payload))
+        self.seq = (self.seq + 1) & 0xFF
+
+    def move(self, words, extrude):
+        for i, axis in enumerate(AXES):
+            if axis not in words or (axis == "E" and not extrude):
+                continue
+            relative = self.relative_e if axis == "E" else not self.absolute
+            value = words[axis]
+            self.pos[i] = self.pos[i] + value if relative else value
+        feed = int(round(words["F"])) if "F" in words else 0
+        mask = 0
+        payload = b""
+        for i in range(4):
+            target = int(round(self.pos[i] * self.spm[i]))
+            if target != self.sent[i]:
+                mask |= 1 << i
+                payload += struct.pack("<i", target)
+                self.sent[i] = target
+        if not mask and not feed:
+            return
+        if feed:
+            self.feedrate = feed
+        self.emit(FRAME_MOVE, bytes([mask]) + payload + struct.pack("<H", feed))
+
+    def line(self, raw):
+        text = raw.split(";", 1)[0].split("*", 1)[0].strip()
+        text = re.sub(r"^[Nn]\d+\s*", "", text)
+        if not text:
+            return
+        words = {}
+        command = None
+        for letter, number in WORD.findall(text):
+            letter = letter.upper()
+            value = float(number) if number else 0.0
+            if command is None and letter in "GMT":
+                command = (letter, int(value))
+            else:
+                words[letter] = value
+        if command in (("G", 0), ("G", 1)):
+            self.move(words, command == ("G", 1))
+            return
+        # Track the state the firmware changes so later targets line up
+        if command == ("G", 90):
+            self.absolute, self.relative_e = True, False
+        elif command == ("G", 91):
+            self.absolute, self.relative_e = False, True
+        elif command == ("M", 82):
+            self.relative_e = False
+        elif command == ("M", 83):
+            self.relative_e = True
+        elif command == ("G", 92):
+            for i, axis in enumerate(AXES):
+                if axis in words:
+                    self.pos[i] = words[axis]
+                    self.sent[i] = int(round(self.pos[i] * self.spm[i]))
+        elif command == ("G", 28):
+            homed = [a for a in "XYZ" if a in words] or list("XYZ")
+            for axis in homed:
+                i = AXES.index(axis)
+                self.pos[i] = 0.0
+                self.sent[i] = 0
+        data = text.encode("ascii", "replace")
+        if len(data) > 94:
+            raise ValueError("line too long for one frame: " + text)
+        self.emit(FRAME_GCODE, data)
+
+
+def stream(frames, port, baud, window):
+    import serial  # pyserial
+
+    link = serial.Serial(port, baud, timeout=5)
+    link.write(b"M880 S1\n")
+    while True:
+        reply = link.readline().decode(errors="replace").strip()
+        if not reply:
+            sys.exit("no reply to M880")
+        if "Binary mode on" in reply:
+            break
+    # Go-back-N: base is the oldest frame without an "ok"
+    sent = base = 0
+    rewound = None
+    while base < len(frames):
+        while sent < len(frames) and sent - base < window:
+            link.write(frames[sent])
+            sent += 1
+        reply = link.readline().decode(errors="replace").strip()
+        match = re.search(r"N(\d+)", reply)
+        if reply.startswith("ok"):
+            # Repeated acks for frames already counted carry an older N
+            if not match or int(match.group(1)) == base & 0xFF:
+                base += 1
+                rewound = None
+        elif reply.startswith("rs") and match:
+            seq = int(match.group(1))
+            if seq != rewound:
+                base += (seq - base) & 0xFF
+                sent = base
+                rewound = seq
+        elif reply:
+            print(reply)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("gcode")
+    parser.add_argument("-o", "--output", help="write frames to this file")
+    parser.add_argument("--port", help="stream to this serial port")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--steps", default="25,25,25,25",
+                        help="steps/mm for X,Y,Z,E (default 25,25,25,25)")
+    parser.add_argument("--window", type=int, default=3,
+                        help="frames in flight while streaming")
+    args = parser.parse_args()
+
+    spm = [float(v) for v in args.steps.split(",")]
+    if len(spm) != 4:
+        parser.error("--steps needs four values")
+    encoder = Encoder(spm)
+    with open(args.gcode, encoding="ascii", errors="replace") as source:
+        for raw in source:
+            encoder.line(raw)
+    encoder.emit(FRAME_EXIT)
+
+    data = b"".join(encoder.frames)
+    if args.output:
+        with open(args.output, "wb") as out:
+            out.write(data)
+    text_size = sum(len(l) for l in open(args.gcode, "rb"))
+    print("%d frames, %d bytes (text %d bytes)" % (len(encoder.frames), len(data), text_size),
+          file=sys.stderr)
+    if args.port:
+        stream(encoder.frames, args.port, args.baud, args.window)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Check the heat-up reports of host runs against their fixtures.
+
+Each fixture in host/heatup is a G-code file whose header holds the limits
+its run must meet, for example
+
+    ; expect: rise<=55 overshoot<=1.0 settle<=70 errors=0
+
+rise, overshoot and settle are read from the firmware's
+"echo:Heat-up ... rise:..s overshoot:..C settle:..s" line; errors counts the
+"ERROR" lines of the whole run and reports the "T:" temperature reports
+printed while an M109 was still waiting for its target. Limits a fixture leaves out are printed but
+not checked, except that any "ERROR" line fails the run whatever the header
+says.
+
+    heatup.py model.gcode build/heatup/model.log pid.gcode build/heatup/pid.log
+"""
+import re
+import sys
+
+REPORT = re.compile(r"echo:Heat-up (\S+)->(\S+) rise:(\S+)s overshoot:(\S+)C settle:(\S+)")
+EXPECT = re.compile(r"(\w+)(<=|=)([\d.]+)")
+COLUMNS = ("rise", "overshoot", "settle", "errors", "reports")
+
+
+def expectations(path):
+    with open(path) as source:
+        for line in source:
+            if line.startswith("; expect:"):
+                return [(m.group(1), m.group(2), float(m.group(3)))
+                        for m in EXPECT.finditer(line)]
+    return []
+
+
+def result(path):
+    """Report values of one run; settle is None when it never settled."""
+    values = {"errors": 0, "reports": 0}
+    heating = False
+    with open(path) as source:
+        for line in source:
+            if line.startswith("ERROR"):
+                values["errors"] += 1
+            if line.startswith("echo:Heating to"):
+                heating = True
+            elif line.startswith("echo:Target temp reached"):
+                heating = False
+            elif heating and line.startswith("T:"):
+                values["reports"] += 1
+            m = REPORT.match(line)
+            if m:
+                values["rise"] = float(m.group(3))
+                values["overshoot"] = float(m.group(4))
+                values["settle"] = None if m.group(5) == "none" else float(m.group(5).rstrip("s"))
+    return values
+
+
+def main():
+    args = sys.argv[1:]
+    if not args or len(args) % 2:
+        sys.exit(__doc__)
+    ok = True
+    print("%-10s %8s %10s %8s %7s %8s" % (("fixture",) + COLUMNS))
+    failures = []
+    for fixture, log in zip(args[::2], args[1::2]):
+        name = fixture.rsplit("/", 1)[-1].rsplit(".", 1)[0]
+        got = result(log)
+        if "rise" not in got:
+            failures.append("%s: no heat-up report" % name)
+            ok = False
+            continue
+        cells = ["-" if got.get(c) is None else "%g" % got[c] for c in COLUMNS]
+        print("%-10s %8s %10s %8s %7s %8s" % tuple([name] + cells))
+        if got["errors"]:
+            failures.append("%s: %d ERROR lines" % (name, got["errors"]))
+            ok = False
+        for key, op, limit in expectations(fixture):
+            value = got.get(key)
+            passed = value is not None and (value <= limit if op == "<=" else value == limit)
+            if not passed:
+                failures.append("%s: %s %s, expected %s%g" % (name, key, value, op, limit))
+                ok = False
+    for failure in failures:
+        print(failure)
+    if not ok:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
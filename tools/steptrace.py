@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""Read step/dir traces recorded by the host runner (firmware_host -r).
+
+Rebuilds each axis' position from the step edges and derives velocity and
+acceleration from it; positions count from where each axis was when the
+trace started. The summary of a trace is what the golden files in
+host/golden hold; compare checks a new trace against one of them.
+
+    steptrace.py dump square.bin > square.csv      # t, then pos/vel/acc per axis
+    steptrace.py summary square.bin > square.json  # make a golden file
+    steptrace.py compare square.bin golden/square.json
+
+compare fails when a step count or end position differs, when the XYZ path
+strays more than --pos-tol mm from the golden one, or when the run is more
+than --time-tol percent slower. Faster runs pass and the gain is printed.
+"""
+import argparse
+import json
+import math
+import struct
+import sys
+
+MAGIC = b"STRC"
+VERSION = 1
+PATH_SPACING = 0.5      # mm of XYZ travel between path samples
+SAMPLE_DT = 0.01        # s between velocity/acceleration samples
+
+
+class Trace:
+    def __init__(self, path):
+        with open(path, "rb") as source:
+            data = source.read()
+        if data[:4] != MAGIC or data[4] != VERSION:
+            raise ValueError("%s: not a version %d step trace" % (path, VERSION))
+        self.hz, count = struct.unpack_from("<IB", data, 5)
+        offset = 10
+        self.axes = []
+        self.spm = []
+        for _ in range(count):
+            letter, _step, _dir, spm = struct.unpack_from("<cBBf", data, offset)
+            self.axes.append(letter.decode())
+            self.spm.append(spm)
+            offset += 7
+
+        # Steps per axis as (seconds, position in steps)
+        self.steps = [[] for _ in self.axes]
+        positive = [True] * count
+        pos = [0] * count
+        ticks = 0
+        while offset < len(data):
+            delta = shift = 0
+            while True:
+                byte = data[offset]
+                offset += 1
+                delta |= (byte & 0x7F) << shift
+                shift += 7
+                if not byte & 0x80:
+                    break
+            code = data[offset]
+            offset += 1
+            ticks += delta
+            axis, level = code & 0x03, bool(code & 0x08)
+            if code & 0x04:
+                positive[axis] = level
+            elif level:
+                pos[axis] += 1 if positive[axis] else -1
+                self.steps[axis].append((ticks / self.hz, pos[axis]))
+        self.duration = ticks / self.hz
+
+    def samples(self, axis, dt=SAMPLE_DT):
+        """Position (mm), velocity and acceleration every dt seconds."""
+        steps, spm = self.steps[axis], self.spm[axis]
+        count = int(self.duration / dt) + 3
+        pos = []
+        i = last = 0
+        for n in range(count):
+            while i < len(steps) and steps[i][0] <= n * dt:
+                last = steps[i][1]
+                i += 1
+            pos.append(last / spm)
+        vel = [0.0] + [(pos[n + 1] - pos[n - 1]) / (2 * dt) for n in range(1, count - 1)] + [0.0]
+        acc = [0.0] + [(vel[n + 1] - vel[n - 1]) / (2 * dt) for n in range(1, count - 1)] + [0.0]
+        return pos, vel, acc
+
+    def xyz_points(self):
+        """XYZ position in mm after every X, Y or Z step, in time order."""
+        events = []
+        for axis in range(min(3, len(self.axes))):
+            events.extend((t, axis, p) for t, p in self.steps[axis])
+        events.sort(key=lambda e: e[0])
+        pos = [0.0, 0.0, 0.0]
+        points = []
+        for _t, axis, p in events:
+            pos[axis] = p / self.spm[axis]
+            points.append(tuple(pos))
+        return points
+
+    def path(self, spacing=PATH_SPACING):
+        """XYZ points spaced `spacing` mm apart along the path."""
+        points = self.xyz_points()
+        if not points:
+            return []
+        samples = [points[0]]
+        for point in points[1:]:
+            if math.dist(point, samples[-1]) >= spacing:
+                samples.append(point)
+        if samples[-1] != points[-1]:
+            samples.append(points[-1])
+        return samples
+
+    def summary(self):
+        axes = {}
+        for axis, letter in enumerate(self.axes):
+            _pos, vel, acc = self.samples(axis)
+            final = self.steps[axis][-1][1] if self.steps[axis] else 0
+            axes[letter] = {
+                "steps_per_mm": round(self.spm[axis], 4),
+                "steps": len(self.steps[axis]),
+                "final_steps": final,
+                "final_mm": round(final / self.spm[axis], 4),
+                "peak_velocity": round(max((abs(v) for v in vel), default=0.0), 1),
+                "peak_accel": round(max((abs(a) for a in acc), default=0.0), 0),
+            }
+        return {
+            "version": VERSION,
+            "timer_hz": self.hz,
+            "duration_s": round(self.duration, 4),
+            "axes": axes,
+            "path_spacing": PATH_SPACING,
+            "path": [[round(c, 4) for c in p] for p in self.path()],
+        }
+
+
+def dump(trace, out):
+    columns = [trace.samples(a) for a in range(len(trace.axes))]
+    header = ["t"]
+    for letter in trace.axes:
+        header += [letter, "v" + letter, "a" + letter]
+    out.write(",".join(header) + "\n")
+    for n in range(len(columns[0][0])):
+        row = ["%.3f" % (n * SAMPLE_DT)]
+        for pos, vel, acc in columns:
+            row += ["%.4f" % pos[n], "%.2f" % vel[n], "%.0f" % acc[n]]
+        out.write(",".join(row) + "\n")
+
+
+def write_summary(summary, out):
+    """JSON with one path point per line, so golden diffs stay readable."""
+    path = summary.pop("path")
+    text = json.dumps(summary, indent=1)
+    points = ",\n".join("  " + json.dumps(p) for p in path)
+    out.write(text[:-2] + ',\n "path": [\n' + points + "\n ]\n}\n")
+
+
+def path_error(golden, points, window=3.0):
+    """Largest distance from a golden path sample to the traced path.
+
+    The golden samples are in path order, so each one is looked for a
+    little ahead of where the previous one matched.
+    """
+    if not points:
+        return math.inf if golden else 0.0
+    travel = [0.0]
+    for a, b in zip(points, points[1:]):
+        travel.append(travel[-1] + math.dist(a, b))
+    worst = 0.0
+    start = 0
+    for sample in golden:
+        best, best_k = math.inf, start
+        k = start
+        while k < len(points) and travel[k] <= travel[start] + window:
+            d = math.dist(sample, points[k])
+            if d < best:
+                best, best_k = d, k
+            k += 1
+        worst = max(worst, best)
+        start = best_k
+    return worst
+
+
+def compare(trace, golden, pos_tol, time_tol):
+    """Prints the differences; returns True when the trace passes."""
+    ok = True
+    current = trace.summary()
+    for letter, want in golden["axes"].items():
+        got = current["axes"].get(letter)
+        if got is None:
+            print("%s: missing from trace" % letter)
+            ok = False
+            continue
+        for key in ("steps", "final_steps"):
+            if got[key] != want[key]:
+                print("%s %s: %d, golden %d" % (letter, key, got[key], want[key]))
+                ok = False
+        print("%s peak velocity %.1f (golden %.1f) mm/s, accel %.0f (golden %.0f) mm/s^2"
+              % (letter, got["peak_velocity"], want["peak_velocity"],
+                 got["peak_accel"], want["peak_accel"]))
+
+    error = path_error([tuple(p) for p in golden["path"]], trace.xyz_points())
+    print("path: %d samples, max deviation %.4f mm (tolerance %.4f)"
+          % (len(golden["path"]), error, pos_tol))
+    if error > pos_tol:
+        ok = False
+
+    change = (trace.duration / golden["duration_s"] - 1) * 100 if golden["duration_s"] else 0.0
+    print("time: %.3f s, golden %.3f s (%+.1f%%)" % (trace.duration, golden["duration_s"], change))
+    if change > time_tol:
+        print("time: slower than the %.1f%% tolerance" % time_tol)
+        ok = False
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("dump", help="CSV of position/velocity/acceleration per axis")
+    p.add_argument("trace")
+    p = sub.add_parser("summary", help="JSON summary, the golden file format")
+    p.add_argument("trace")
+    p = sub.add_parser("compare", help="check a trace against a golden file")
+    p.add_argument("trace")
+    p.add_argument("golden")
+    p.add_argument("--pos-tol", type=float, default=0.1, help="mm (default 0.1)")
+    p.add_argument("--time-tol", type=float, default=5.0,
+                   help="percent slower allowed (default 5)")
+    args = parser.parse_args()
+
+    trace = Trace(args.trace)
+    if args.command == "dump":
+        dump(trace, sys.stdout)
+    elif args.command == "summary":
+        write_summary(trace.summary(), sys.stdout)
+    else:
+        with open(args.golden) as source:
+            golden = json.load(source)
+        if not compare(trace, golden, args.pos_tol, args.time_tol):
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()